@@ -0,0 +1,78 @@
+// Copyright (c) 2015-2016 The Bitcoin Core developers
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "utiltime.h"
+
+#include <iomanip>
+#include <iostream>
+
+std::map<std::string, benchmark::BenchFunction> benchmark::BenchRunner::benchmarks;
+
+static double gettimedouble(void) {
+    return GetTimeMicros() * 0.000001;
+}
+
+benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction func)
+{
+    benchmarks.insert(std::make_pair(name, func));
+}
+
+void
+benchmark::BenchRunner::RunAll(const std::string& strFilter, double elapsedTimeForOne, int nWarmup)
+{
+    std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+
+    for (std::map<std::string,benchmark::BenchFunction>::iterator it = benchmarks.begin();
+         it != benchmarks.end(); ++it) {
+
+        if (it->first.find(strFilter) == std::string::npos)
+            continue;
+        State state(it->first, elapsedTimeForOne, nWarmup);
+        benchmark::BenchFunction& func = it->second;
+        func(state);
+    }
+}
+
+bool
+benchmark::State::KeepRunning()
+{
+    if (nWarmup > 0) {
+        --nWarmup;
+        return true;
+    }
+
+    double now;
+    if (count == 0) {
+        beginTime = now = gettimedouble();
+    }
+    else {
+        // timeCheckCount is used to avoid calling gettime most of the time,
+        // so benchmarks that run very quickly get consistent results.
+        if ((count+1)%timeCheckCount != 0) {
+            ++count;
+            return true; // keep going
+        }
+        now = gettimedouble();
+        double elapsedOne = (now - lastTime)/timeCheckCount;
+        if (elapsedOne < minTime) minTime = elapsedOne;
+        if (elapsedOne > maxTime) maxTime = elapsedOne;
+        if (elapsedOne*timeCheckCount < maxElapsed/16) timeCheckCount *= 2;
+    }
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed) return true; // Keep going
+
+    --count;
+
+    // Output results
+    double average = (now-beginTime)/count;
+    std::cout << std::fixed << std::setprecision(15) << name << "," << count << "," << minTime << "," << maxTime << "," << average << "\n";
+    std::cout.flush();
+
+    return false;
+}
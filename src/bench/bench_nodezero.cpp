@@ -0,0 +1,47 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "guiinterface.h"
+#include "key.h"
+#include "pubkey.h"
+#include "util.h"
+
+#include <iostream>
+
+CClientUIInterface uiInterface;
+class CWallet;
+CWallet* pwalletMain;
+
+int
+main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_nodezero [-filter=<substring>] [-time=<seconds>] [-warmup=<iterations>]\n"
+                  << "Prints one CSV line per benchmark: name,count,min,max,average (seconds per iteration).\n";
+        return 0;
+    }
+
+    ECC_Start();
+    ECCVerifyHandle globalVerifyHandle;
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::MAIN);
+
+#if defined(USE_NUM_GMP)
+    std::cout << "#bignum backend: gmp\n";
+#else
+    std::cout << "#bignum backend: openssl\n";
+#endif
+
+    double elapsedTimeForOne = atof(GetArg("-time", "1.0").c_str());
+    int nWarmup = std::max((int)GetArg("-warmup", 1), 0);
+    benchmark::BenchRunner::RunAll(GetArg("-filter", ""), elapsedTimeForOne, nWarmup);
+
+    ECC_Stop();
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "libzerocoin/Params.h"
+#include "libzerocoin/bignum.h"
+
+// The operands are the accumulator modulus and values below it, the sizes the
+// accumulator proofs work with. Only the backend selected at configure time
+// (gmp or openssl) is linked in; bench_nodezero reports which one it ran.
+
+static const CBigNum& BenchModulus()
+{
+    return Params().Zerocoin_Params(false)->accumulatorParams.accumulatorModulus;
+}
+
+static void BigNumMulMod(benchmark::State& state)
+{
+    const CBigNum& modulus = BenchModulus();
+    CBigNum a = CBigNum::randBignum(modulus);
+    CBigNum b = CBigNum::randBignum(modulus);
+    while (state.KeepRunning()) {
+        a = a.mul_mod(b, modulus);
+    }
+}
+
+static void BigNumPowMod(benchmark::State& state)
+{
+    const CBigNum& modulus = BenchModulus();
+    CBigNum base = CBigNum::randBignum(modulus);
+    CBigNum e = CBigNum::randBignum(modulus);
+    while (state.KeepRunning()) {
+        CBigNum r = base.pow_mod(e, modulus);
+    }
+}
+
+static void BigNumMontgomeryMulMod(benchmark::State& state)
+{
+    CBigNumMontgomery mont(BenchModulus());
+    CBigNum a = CBigNum::randBignum(BenchModulus());
+    CBigNum b = CBigNum::randBignum(BenchModulus());
+    while (state.KeepRunning()) {
+        a = mont.mul_mod(a, b);
+    }
+}
+
+static void BigNumMontgomeryPowMod(benchmark::State& state)
+{
+    CBigNumMontgomery mont(BenchModulus());
+    CBigNum base = CBigNum::randBignum(BenchModulus());
+    CBigNum e = CBigNum::randBignum(BenchModulus());
+    while (state.KeepRunning()) {
+        CBigNum r = mont.pow_mod(base, e);
+    }
+}
+
+static void BigNumFixedBasePowMod(benchmark::State& state)
+{
+    const CBigNum& modulus = BenchModulus();
+    CBigNumFixedBase table(CBigNum::randBignum(modulus), modulus, modulus.bitSize());
+    CBigNum e = CBigNum::randBignum(modulus);
+    while (state.KeepRunning()) {
+        CBigNum r = table.pow_mod(e);
+    }
+}
+
+static void BigNumMultiPowMod(benchmark::State& state)
+{
+    CBigNumMontgomery mont(BenchModulus());
+    std::vector<CBigNum> vBases, vExps;
+    for (int i = 0; i < 3; i++) {
+        vBases.push_back(CBigNum::randBignum(BenchModulus()));
+        vExps.push_back(CBigNum::randBignum(BenchModulus()));
+    }
+    while (state.KeepRunning()) {
+        CBigNum r = CBigNum::multi_pow_mod(vBases, vExps, mont);
+    }
+}
+
+BENCHMARK(BigNumMulMod);
+BENCHMARK(BigNumPowMod);
+BENCHMARK(BigNumMontgomeryMulMod);
+BENCHMARK(BigNumMontgomeryPowMod);
+BENCHMARK(BigNumFixedBasePowMod);
+BENCHMARK(BigNumMultiPowMod);
@@ -0,0 +1,147 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "key.h"
+#include "libzerocoin/Accumulator.h"
+#include "libzerocoin/Coin.h"
+#include "libzerocoin/CoinSpend.h"
+#include "libzerocoin/Denominations.h"
+#include "random.h"
+#include "zNZR/accumulators.h"
+#ifdef ENABLE_WALLET
+#include "zNZR/zNZRmodule.h"
+#endif
+
+#include <stdexcept>
+
+using namespace libzerocoin;
+
+//! Number of coins in the accumulator a benchmarked spend proves membership in
+static const int BENCH_ACCUMULATED_COINS = 10;
+
+//! A minted coin along with an accumulator and a witness for it, built outside of the timed loop
+class CBenchSpendSetup
+{
+public:
+    ZerocoinParams* paramsCoin;
+    ZerocoinParams* paramsAcc;
+    PrivateCoin coin;
+    Accumulator accumulator;
+    AccumulatorWitness witness;
+
+    CBenchSpendSetup(bool fUseModulusV1) :
+        paramsCoin(Params().Zerocoin_Params(fUseModulusV1)),
+        paramsAcc(Params().Zerocoin_Params(false)),
+        coin(paramsCoin, CoinDenomination::ZQ_ONE),
+        accumulator(paramsAcc, CoinDenomination::ZQ_ONE),
+        witness(paramsAcc, accumulator, coin.getPublicCoin())
+    {
+        for (int i = 0; i < BENCH_ACCUMULATED_COINS; i++) {
+            PrivateCoin other(paramsAcc, CoinDenomination::ZQ_ONE);
+            accumulator += other.getPublicCoin();
+            witness += other.getPublicCoin();
+        }
+        accumulator += coin.getPublicCoin();
+    }
+};
+
+static void ZerocoinMint(benchmark::State& state)
+{
+    ZerocoinParams* params = Params().Zerocoin_Params(false);
+    while (state.KeepRunning()) {
+        PrivateCoin coin(params, CoinDenomination::ZQ_ONE);
+    }
+}
+
+static void ZerocoinAccumulate(benchmark::State& state)
+{
+    ZerocoinParams* params = Params().Zerocoin_Params(false);
+    PrivateCoin coin(params, CoinDenomination::ZQ_ONE);
+    const PublicCoin& pubCoin = coin.getPublicCoin();
+    Accumulator accumulator(params, CoinDenomination::ZQ_ONE);
+    while (state.KeepRunning()) {
+        accumulator += pubCoin;
+    }
+}
+
+static void ZerocoinWitnessUpdate(benchmark::State& state)
+{
+    ZerocoinParams* params = Params().Zerocoin_Params(false);
+    PrivateCoin coin(params, CoinDenomination::ZQ_ONE);
+    PrivateCoin other(params, CoinDenomination::ZQ_ONE);
+    const PublicCoin& pubCoin = other.getPublicCoin();
+    Accumulator accumulator(params, CoinDenomination::ZQ_ONE);
+    AccumulatorWitness witness(params, accumulator, coin.getPublicCoin());
+    while (state.KeepRunning()) {
+        witness += pubCoin;
+    }
+}
+
+static void CoinSpendCreate(benchmark::State& state, bool fUseModulusV1)
+{
+    CBenchSpendSetup setup(fUseModulusV1);
+    uint256 ptxHash = GetRandHash();
+    uint32_t nChecksum = GetChecksum(setup.accumulator.getValue());
+    while (state.KeepRunning()) {
+        CoinSpend spend(setup.paramsCoin, setup.paramsAcc, setup.coin, setup.accumulator, nChecksum,
+                        setup.witness, ptxHash, SpendType::SPEND);
+    }
+}
+
+static void CoinSpendVerify(benchmark::State& state, bool fUseModulusV1)
+{
+    CBenchSpendSetup setup(fUseModulusV1);
+    CoinSpend spend(setup.paramsCoin, setup.paramsAcc, setup.coin, setup.accumulator,
+                    GetChecksum(setup.accumulator.getValue()), setup.witness, GetRandHash(), SpendType::SPEND);
+    while (state.KeepRunning()) {
+        bool fValid = spend.Verify(setup.accumulator);
+        fValid &= spend.HasValidSerial(setup.paramsCoin);
+        fValid &= spend.HasValidSignature();
+        if (!fValid)
+            throw std::runtime_error("CoinSpendVerify: spend did not verify");
+    }
+}
+
+static void CoinSpendCreateV1(benchmark::State& state) { CoinSpendCreate(state, true); }
+static void CoinSpendCreateV2(benchmark::State& state) { CoinSpendCreate(state, false); }
+static void CoinSpendVerifyV1(benchmark::State& state) { CoinSpendVerify(state, true); }
+static void CoinSpendVerifyV2(benchmark::State& state) { CoinSpendVerify(state, false); }
+
+#ifdef ENABLE_WALLET
+static void PublicCoinSpendValidate(benchmark::State& state)
+{
+    ZerocoinParams* params = Params().Zerocoin_Params(false);
+    PrivateCoin coin(params, CoinDenomination::ZQ_ONE);
+    CKey key;
+    if (!key.SetPrivKey(coin.getPrivKey(), true))
+        throw std::runtime_error("PublicCoinSpendValidate: invalid coin key");
+
+    PublicCoinSpend spend(params, coin.getSerialNumber(), coin.getRandomness(), key.GetPubKey());
+    spend.pubCoin = coin.getPublicCoin();
+    spend.setTxOutHash(GetRandHash());
+    spend.setDenom(coin.getPublicCoin().getDenomination());
+    std::vector<unsigned char> vchSig;
+    if (!key.Sign(spend.signatureHash(), vchSig))
+        throw std::runtime_error("PublicCoinSpendValidate: signing failed");
+    spend.setVchSig(vchSig);
+
+    while (state.KeepRunning()) {
+        if (!spend.validate())
+            throw std::runtime_error("PublicCoinSpendValidate: spend did not validate");
+    }
+}
+
+BENCHMARK(PublicCoinSpendValidate);
+#endif
+
+BENCHMARK(ZerocoinMint);
+BENCHMARK(ZerocoinAccumulate);
+BENCHMARK(ZerocoinWitnessUpdate);
+BENCHMARK(CoinSpendCreateV1);
+BENCHMARK(CoinSpendCreateV2);
+BENCHMARK(CoinSpendVerifyV1);
+BENCHMARK(CoinSpendVerifyV2);
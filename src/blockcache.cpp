@@ -0,0 +1,93 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "memusage.h"
+
+CBlockCache blockCache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+
+//! Estimate of the heap memory held by a decoded block
+static size_t BlockMemoryUsage(const CBlock& block)
+{
+    size_t nUsage = memusage::MallocUsage(sizeof(CBlock));
+    nUsage += memusage::DynamicUsage(block.vtx) + memusage::DynamicUsage(block.vchBlockSig) + memusage::DynamicUsage(block.vMerkleTree);
+    for (const CTransaction& tx : block.vtx) {
+        nUsage += memusage::DynamicUsage(tx.vin) + memusage::DynamicUsage(tx.vout);
+        for (const CTxIn& txin : tx.vin)
+            nUsage += memusage::DynamicUsage(txin.scriptSig);
+        for (const CTxOut& txout : tx.vout)
+            nUsage += memusage::DynamicUsage(txout.scriptPubKey);
+    }
+    return nUsage;
+}
+
+void CBlockCache::Trim()
+{
+    while (nUsage > nMaxUsage && !listEntries.empty()) {
+        nUsage -= listEntries.back().second.second;
+        mapEntries.erase(listEntries.back().first);
+        listEntries.pop_back();
+    }
+}
+
+std::shared_ptr<const CBlock> CBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    std::map<uint256, EntryList::iterator>::iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return std::shared_ptr<const CBlock>();
+    listEntries.splice(listEntries.begin(), listEntries, it->second);
+    return it->second->second.first;
+}
+
+bool CBlockCache::Contains(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapEntries.count(hash) > 0;
+}
+
+void CBlockCache::Insert(const uint256& hash, const std::shared_ptr<const CBlock>& pblock)
+{
+    // Include the list and map nodes and the shared_ptr control block
+    size_t nEntryUsage = BlockMemoryUsage(*pblock) +
+                         memusage::MallocUsage(sizeof(CacheEntry) + 2 * sizeof(void*)) +
+                         memusage::MallocUsage(sizeof(std::pair<const uint256, EntryList::iterator>) + 4 * sizeof(void*)) +
+                         memusage::MallocUsage(4 * sizeof(void*));
+
+    LOCK(cs);
+    if (mapEntries.count(hash) || nEntryUsage > nMaxUsage)
+        return;
+    listEntries.push_front(std::make_pair(hash, std::make_pair(pblock, nEntryUsage)));
+    mapEntries[hash] = listEntries.begin();
+    nUsage += nEntryUsage;
+    Trim();
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    listEntries.clear();
+    mapEntries.clear();
+    nUsage = 0;
+}
+
+void CBlockCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+size_t CBlockCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return nUsage;
+}
+
+size_t CBlockCache::GetSize() const
+{
+    LOCK(cs);
+    return listEntries.size();
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+
+//! -blockcachesize default (MiB)
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+//! Blocks read from disk are only cached when they are this close to the tip
+static const int BLOCK_CACHE_DEPTH = 2000;
+
+/**
+ * Least recently used cache of decoded blocks, bounded by an estimate of
+ * their memory usage. Cached blocks are shared between threads and must not
+ * be modified; their merkle tree is built before they are added so that
+ * GetMerkleBranch doesn't write to them either.
+ */
+class CBlockCache
+{
+private:
+    typedef std::pair<uint256, std::pair<std::shared_ptr<const CBlock>, size_t> > CacheEntry;
+    typedef std::list<CacheEntry> EntryList;
+
+    mutable CCriticalSection cs;
+    size_t nMaxUsage;
+    size_t nUsage;
+    //! Most recently used first
+    EntryList listEntries;
+    std::map<uint256, EntryList::iterator> mapEntries;
+
+    void Trim();
+
+public:
+    CBlockCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0) {}
+
+    //! The cached block with this hash, or NULL
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+    bool Contains(const uint256& hash) const;
+    //! Add a block that is no longer modified; it must have its merkle tree built
+    void Insert(const uint256& hash, const std::shared_ptr<const CBlock>& pblock);
+    void Clear();
+
+    void SetMaxUsage(size_t nMaxUsageIn);
+    size_t DynamicMemoryUsage() const;
+    size_t GetSize() const;
+};
+
+/** Decoded blocks shared by block readers */
+extern CBlockCache blockCache;
+
+#endif // BITCOIN_BLOCKCACHE_H
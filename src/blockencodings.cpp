@@ -0,0 +1,167 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <limits>
+
+#include <boost/unordered_map.hpp>
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) : nNonce(GetRand(std::numeric_limits<uint64_t>::max())),
+                                                                           header(block.GetBlockHeader()),
+                                                                           vchBlockSig(block.vchBlockSig)
+{
+    FillShortTxIDSelector();
+    // The coinbase, and the coinstake of a proof-of-stake block, are never in a peer's mempool
+    size_t nPrefill = block.IsProofOfStake() ? 2 : 1;
+    nPrefill = std::min(nPrefill, block.vtx.size());
+    for (size_t i = 0; i < nPrefill; i++)
+        vPrefilledTxn.push_back(CPrefilledTransaction(i, block.vtx[i]));
+    vShortTxIds.reserve(block.vtx.size() - nPrefill);
+    for (size_t i = nPrefill; i < block.vtx.size(); i++)
+        vShortTxIds.push_back(GetShortID(block.vtx[i].GetHash()));
+}
+
+void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nNonce;
+    uint256 hash;
+    CSHA256().Write((const unsigned char*)&stream[0], stream.size()).Finalize(hash.begin());
+    nShortIdK0 = hash.Get64(0);
+    nShortIdK1 = hash.Get64(1);
+}
+
+uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const
+{
+    return SipHashUint256(nShortIdK0, nShortIdK1, txhash) & 0xffffffffffffL;
+}
+
+ReadStatus CPartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool)
+{
+    if (cmpctblock.header.IsNull() || (cmpctblock.vShortTxIds.empty() && cmpctblock.vPrefilledTxn.empty()))
+        return READ_STATUS_INVALID;
+    if (cmpctblock.BlockTxCount() > MAX_COMPACT_BLOCK_TXS)
+        return READ_STATUS_INVALID;
+
+    assert(header.IsNull() && vtxAvailable.empty());
+    header = cmpctblock.header;
+    vchBlockSig = cmpctblock.vchBlockSig;
+    vtxAvailable.resize(cmpctblock.BlockTxCount());
+    vHave.assign(cmpctblock.BlockTxCount(), false);
+
+    int nLastIndex = -1;
+    for (size_t i = 0; i < cmpctblock.vPrefilledTxn.size(); i++) {
+        const CPrefilledTransaction& prefilled = cmpctblock.vPrefilledTxn[i];
+        if (prefilled.tx.IsNull() || (int)prefilled.nIndex <= nLastIndex || prefilled.nIndex >= vtxAvailable.size())
+            return READ_STATUS_INVALID;
+        vtxAvailable[prefilled.nIndex] = prefilled.tx;
+        vHave[prefilled.nIndex] = true;
+        nLastIndex = prefilled.nIndex;
+    }
+    nPrefilled = cmpctblock.vPrefilledTxn.size();
+
+    // Short ids fill the positions left free by the prefilled transactions, in order
+    boost::unordered_map<uint64_t, uint16_t> mapShortIds;
+    mapShortIds.reserve(cmpctblock.vShortTxIds.size());
+    size_t nIndex = 0;
+    for (size_t i = 0; i < cmpctblock.vShortTxIds.size(); i++) {
+        while (vHave[nIndex])
+            nIndex++;
+        mapShortIds[cmpctblock.vShortTxIds[i]] = nIndex;
+        nIndex++;
+    }
+    // Two transactions of the block sharing a short id cannot be told apart; take the whole block
+    if (mapShortIds.size() != cmpctblock.vShortTxIds.size())
+        return READ_STATUS_FAILED;
+
+    // Positions matched by more than one mempool transaction are left to getblocktxn
+    std::vector<bool> vMatched(vtxAvailable.size(), false);
+    {
+        LOCK(pool.cs);
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = pool.mapTx.begin(); it != pool.mapTx.end() && nFromMempool < mapShortIds.size(); ++it) {
+            boost::unordered_map<uint64_t, uint16_t>::const_iterator itId = mapShortIds.find(cmpctblock.GetShortID(it->first));
+            if (itId == mapShortIds.end())
+                continue;
+            uint16_t nPos = itId->second;
+            if (!vMatched[nPos]) {
+                vtxAvailable[nPos] = it->second.GetTx();
+                vHave[nPos] = true;
+                vMatched[nPos] = true;
+                nFromMempool++;
+            } else if (vHave[nPos]) {
+                vtxAvailable[nPos] = CTransaction();
+                vHave[nPos] = false;
+                nFromMempool--;
+            }
+        }
+    }
+
+    LogPrint("cmpctblock", "Initialized PartiallyDownloadedBlock for block %s using a cmpctblock of size %u\n", cmpctblock.header.GetHash().ToString(),
+        (unsigned int)GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
+bool CPartiallyDownloadedBlock::IsTxAvailable(size_t nIndex) const
+{
+    assert(!header.IsNull());
+    assert(nIndex < vHave.size());
+    return vHave[nIndex];
+}
+
+std::vector<uint16_t> CPartiallyDownloadedBlock::GetMissing() const
+{
+    std::vector<uint16_t> vMissing;
+    for (size_t i = 0; i < vHave.size(); i++)
+        if (!vHave[i])
+            vMissing.push_back(i);
+    return vMissing;
+}
+
+ReadStatus CPartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing)
+{
+    assert(!header.IsNull());
+    uint256 hash = header.GetHash();
+    block = header;
+    block.vtx.resize(vtxAvailable.size());
+
+    size_t nMissingUsed = 0;
+    for (size_t i = 0; i < vtxAvailable.size(); i++) {
+        if (vHave[i]) {
+            block.vtx[i] = vtxAvailable[i];
+        } else {
+            if (nMissingUsed >= vtxMissing.size())
+                return READ_STATUS_INVALID;
+            block.vtx[i] = vtxMissing[nMissingUsed++];
+        }
+    }
+    block.vchBlockSig = vchBlockSig;
+
+    // Make sure we can't call FillBlock again
+    header.SetNull();
+    vtxAvailable.clear();
+    vHave.clear();
+
+    if (nMissingUsed != vtxMissing.size())
+        return READ_STATUS_INVALID;
+
+    // A short id collision with a mempool transaction shows up as a wrong merkle root
+    bool fMutated = false;
+    if (block.BuildMerkleTree(&fMutated) != block.hashMerkleRoot || fMutated)
+        return READ_STATUS_FAILED;
+
+    LogPrint("cmpctblock", "Successfully reconstructed block %s with %u txn prefilled, %u txn from mempool and %u txn requested\n", hash.ToString(),
+        (unsigned int)nPrefilled, (unsigned int)nFromMempool, (unsigned int)vtxMissing.size());
+
+    return READ_STATUS_OK;
+}
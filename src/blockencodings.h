@@ -0,0 +1,219 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <ios>
+#include <stdint.h>
+#include <vector>
+
+class CTxMemPool;
+
+//! Number of transactions a compact block can announce, bounded by the smallest possible transaction
+static const unsigned int MAX_COMPACT_BLOCK_TXS = MAX_BLOCK_SIZE_CURRENT / 60;
+
+//! Blocks this far below the tip are still served as compact blocks and blocktxn
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+
+/** A transaction sent along with a compact block, at its position in the block */
+class CPrefilledTransaction
+{
+public:
+    //! position in the block; sent as the difference to the previous prefilled one
+    uint16_t nIndex;
+    CTransaction tx;
+
+    CPrefilledTransaction() : nIndex(0) {}
+    CPrefilledTransaction(uint16_t nIndexIn, const CTransaction& txIn) : nIndex(nIndexIn), tx(txIn) {}
+};
+
+/**
+ * A block announced as its header and 6-byte short ids of its transactions,
+ * keyed by the header and a nonce so that collisions cannot be ground in
+ * advance. The coinbase and the coinstake, which no peer can have in its
+ * mempool, are sent in full, as is the block signature.
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t nShortIdK0, nShortIdK1;
+    uint64_t nNonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class CPartiallyDownloadedBlock;
+
+public:
+    CBlockHeader header;
+    std::vector<uint64_t> vShortTxIds;
+    std::vector<CPrefilledTransaction> vPrefilledTxn;
+    std::vector<unsigned char> vchBlockSig;
+
+    //! Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() : nShortIdK0(0), nShortIdK1(0), nNonce(0) {}
+
+    CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return vShortTxIds.size() + vPrefilledTxn.size(); }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s << header << nNonce;
+        WriteCompactSize(s, vShortTxIds.size());
+        for (size_t i = 0; i < vShortTxIds.size(); i++) {
+            uint32_t nLsb = vShortTxIds[i] & 0xffffffff;
+            uint16_t nMsb = (vShortTxIds[i] >> 32) & 0xffff;
+            s << nLsb << nMsb;
+        }
+        WriteCompactSize(s, vPrefilledTxn.size());
+        int nLastIndex = -1;
+        for (size_t i = 0; i < vPrefilledTxn.size(); i++) {
+            WriteCompactSize(s, vPrefilledTxn[i].nIndex - nLastIndex - 1);
+            nLastIndex = vPrefilledTxn[i].nIndex;
+            s << vPrefilledTxn[i].tx;
+        }
+        s << vchBlockSig;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        s >> header >> nNonce;
+        uint64_t nShortIds = ReadCompactSize(s);
+        if (nShortIds > MAX_COMPACT_BLOCK_TXS)
+            throw std::ios_base::failure("too many short ids");
+        vShortTxIds.resize(nShortIds);
+        for (size_t i = 0; i < vShortTxIds.size(); i++) {
+            uint32_t nLsb;
+            uint16_t nMsb;
+            s >> nLsb >> nMsb;
+            vShortTxIds[i] = ((uint64_t)nMsb << 32) | (uint64_t)nLsb;
+        }
+        uint64_t nPrefilled = ReadCompactSize(s);
+        if (nPrefilled > MAX_COMPACT_BLOCK_TXS)
+            throw std::ios_base::failure("too many prefilled transactions");
+        vPrefilledTxn.resize(nPrefilled);
+        uint64_t nNextIndex = 0;
+        for (size_t i = 0; i < vPrefilledTxn.size(); i++) {
+            nNextIndex += ReadCompactSize(s);
+            if (nNextIndex >= MAX_COMPACT_BLOCK_TXS)
+                throw std::ios_base::failure("prefilled transaction index overflowed");
+            vPrefilledTxn[i].nIndex = nNextIndex++;
+            s >> vPrefilledTxn[i].tx;
+        }
+        s >> vchBlockSig;
+        FillShortTxIDSelector();
+    }
+};
+
+/** Positions in a block of the transactions a compact block could not be completed without */
+class CBlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    //! sent as differences to the previous index
+    std::vector<uint16_t> vIndexes;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s << blockhash;
+        WriteCompactSize(s, vIndexes.size());
+        int nLastIndex = -1;
+        for (size_t i = 0; i < vIndexes.size(); i++) {
+            WriteCompactSize(s, vIndexes[i] - nLastIndex - 1);
+            nLastIndex = vIndexes[i];
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        s >> blockhash;
+        uint64_t nIndexes = ReadCompactSize(s);
+        if (nIndexes > MAX_COMPACT_BLOCK_TXS)
+            throw std::ios_base::failure("too many requested indexes");
+        vIndexes.resize(nIndexes);
+        uint64_t nNextIndex = 0;
+        for (size_t i = 0; i < vIndexes.size(); i++) {
+            nNextIndex += ReadCompactSize(s);
+            if (nNextIndex >= MAX_COMPACT_BLOCK_TXS)
+                throw std::ios_base::failure("requested index overflowed");
+            vIndexes[i] = nNextIndex++;
+        }
+    }
+};
+
+/** The transactions asked for by a CBlockTransactionsRequest, in the order they were asked for */
+class CBlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> vtx;
+
+    CBlockTransactions() {}
+    CBlockTransactions(const CBlockTransactionsRequest& req) : blockhash(req.blockhash), vtx(req.vIndexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(blockhash);
+        READWRITE(vtx);
+    }
+};
+
+enum ReadStatus {
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, //! the peer sent something malformed
+    READ_STATUS_FAILED,  //! could not be reconstructed, e.g. on a short id collision; fall back to the full block
+};
+
+/** A block being rebuilt from a compact block and our mempool */
+class CPartiallyDownloadedBlock
+{
+private:
+    std::vector<CTransaction> vtxAvailable;
+    std::vector<bool> vHave;
+    size_t nPrefilled;
+    size_t nFromMempool;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    CPartiallyDownloadedBlock() : nPrefilled(0), nFromMempool(0) {}
+
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const CTxMemPool& pool);
+    bool IsTxAvailable(size_t nIndex) const;
+    //! Positions of the transactions still missing after InitData
+    std::vector<uint16_t> GetMissing() const;
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtxMissing);
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
@@ -0,0 +1,97 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "main.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    if (nSize > 0)
+        munmap((void*)pdata, nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFile::Open(const boost::filesystem::path& path)
+{
+#ifdef WIN32
+    // Not implemented; callers fall back to reading through a FILE*
+    return std::shared_ptr<const CMappedFile>();
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        LogPrintf("%s : unable to open file %s\n", __func__, path.string());
+        return std::shared_ptr<const CMappedFile>();
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return std::shared_ptr<const CMappedFile>();
+    }
+    size_t nSize = st.st_size;
+    void* pdata = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (pdata == MAP_FAILED) {
+        LogPrintf("%s : unable to map file %s\n", __func__, path.string());
+        return std::shared_ptr<const CMappedFile>();
+    }
+    return std::shared_ptr<const CMappedFile>(new CMappedFile((const unsigned char*)pdata, nSize));
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CBlockFileMapCache::Get(int nFile)
+{
+    {
+        LOCK(cs);
+        std::map<int, MappingList::iterator>::iterator it = mapFiles.find(nFile);
+        if (it != mapFiles.end()) {
+            listMappings.splice(listMappings.begin(), listMappings, it->second);
+            return it->second->second;
+        }
+    }
+
+    // Map outside the lock; if two threads race, the second mapping replaces the first
+    std::shared_ptr<const CMappedFile> mapped = CMappedFile::Open(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    if (!mapped)
+        return mapped;
+
+    LOCK(cs);
+    std::map<int, MappingList::iterator>::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end())
+        listMappings.erase(it->second);
+    listMappings.push_front(std::make_pair(nFile, mapped));
+    mapFiles[nFile] = listMappings.begin();
+    while (listMappings.size() > nMaxFiles) {
+        mapFiles.erase(listMappings.back().first);
+        listMappings.pop_back();
+    }
+    return mapped;
+}
+
+void CBlockFileMapCache::Erase(int nFile)
+{
+    LOCK(cs);
+    std::map<int, MappingList::iterator>::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end()) {
+        listMappings.erase(it->second);
+        mapFiles.erase(it);
+    }
+}
+
+void CBlockFileMapCache::Clear()
+{
+    LOCK(cs);
+    listMappings.clear();
+    mapFiles.clear();
+}
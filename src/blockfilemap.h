@@ -0,0 +1,79 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "streams.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+
+#include <boost/filesystem/path.hpp>
+
+/** Number of block files kept mapped by the block file map cache */
+static const unsigned int MAX_BLOCK_FILE_MAPPINGS = 8;
+//! -blockmmap default: only where the address space is large enough for the mappings
+static const bool DEFAULT_BLOCK_MMAP = sizeof(void*) >= 8;
+
+/** A read-only memory mapping of a whole file. */
+class CMappedFile
+{
+private:
+    const unsigned char* pdata;
+    size_t nSize;
+
+    CMappedFile(const unsigned char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+
+    // Disallow copies
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+public:
+    ~CMappedFile();
+
+    //! Map the file at path, or return NULL if it can't be opened or mapped
+    static std::shared_ptr<const CMappedFile> Open(const boost::filesystem::path& path);
+
+    size_t size() const { return nSize; }
+
+    //! Stream reading the file from nPos to its end; empty if nPos is past the end
+    CSpanReader GetReader(size_t nPos, int nType, int nVersion) const
+    {
+        const unsigned char* pend = pdata + nSize;
+        return CSpanReader(nPos < nSize ? pdata + nPos : pend, pend, nType, nVersion);
+    }
+};
+
+/**
+ * Least recently used set of memory mapped blk?????.dat files. Only files that
+ * will not be written to anymore may be mapped, as the mapping is of the size
+ * the file had when it was opened. Mappings stay valid for as long as a caller
+ * holds on to them, even after they were evicted or erased.
+ */
+class CBlockFileMapCache
+{
+private:
+    typedef std::list<std::pair<int, std::shared_ptr<const CMappedFile> > > MappingList;
+
+    CCriticalSection cs;
+    size_t nMaxFiles;
+    //! Most recently used first
+    MappingList listMappings;
+    std::map<int, MappingList::iterator> mapFiles;
+
+public:
+    CBlockFileMapCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    //! The mapping of block file nFile, mapping it if needed; NULL on failure
+    std::shared_ptr<const CMappedFile> Get(int nFile);
+    //! Forget the mapping of nFile, to be called before the file is changed or removed
+    void Erase(int nFile);
+    void Clear();
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
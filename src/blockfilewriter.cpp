@@ -0,0 +1,150 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilewriter.h"
+
+#include "main.h"
+#include "util.h"
+#include "utiltime.h"
+
+CBlockFileWriter::CBlockFileWriter(size_t nMaxPendingBytesIn) : nPendingBytes(0), nMaxPendingBytes(nMaxPendingBytesIn), nFlushRequested(0), nFlushDone(0), fFailed(false), fStop(false)
+{
+    threadWrite = std::thread([this] { TraceThread("blockwrite", [this] { ThreadWrite(); }); });
+}
+
+CBlockFileWriter::~CBlockFileWriter()
+{
+    Flush();
+    {
+        WaitableLock lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    threadWrite.join();
+}
+
+bool CBlockFileWriter::WriteToFile(const CPendingWrite& write)
+{
+    std::pair<int, bool> key(write.pos.nFile, write.fUndo);
+    std::map<std::pair<int, bool>, FILE*>::iterator it = mapOpenFiles.find(key);
+    if (it == mapOpenFiles.end()) {
+        FILE* file = write.fUndo ? OpenUndoFile(write.pos) : OpenBlockFile(write.pos);
+        if (!file)
+            return false;
+        it = mapOpenFiles.insert(std::make_pair(key, file)).first;
+    } else if (fseek(it->second, write.pos.nPos, SEEK_SET)) {
+        return error("%s : unable to seek to position %u in %s%05u.dat", __func__, write.pos.nPos, write.fUndo ? "rev" : "blk", write.pos.nFile);
+    }
+    const std::vector<char>& vData = *write.data;
+    if (fwrite(vData.data(), 1, vData.size(), it->second) != vData.size())
+        return error("%s : failed to write %u bytes to %s%05u.dat", __func__, (unsigned int)vData.size(), write.fUndo ? "rev" : "blk", write.pos.nFile);
+    // Readers open the file themselves once the data is no longer queued
+    if (fflush(it->second))
+        return error("%s : failed to flush %s%05u.dat", __func__, write.fUndo ? "rev" : "blk", write.pos.nFile);
+    return true;
+}
+
+void CBlockFileWriter::CommitFiles()
+{
+    int64_t nStart = GetTimeMicros();
+    size_t nFiles = mapOpenFiles.size();
+    for (std::map<std::pair<int, bool>, FILE*>::iterator it = mapOpenFiles.begin(); it != mapOpenFiles.end(); ++it) {
+        FileCommit(it->second);
+        fclose(it->second);
+    }
+    mapOpenFiles.clear();
+    LogPrint("bench", "%s : committed %u files in %.2fms\n", __func__, (unsigned int)nFiles, 0.001 * (GetTimeMicros() - nStart));
+}
+
+void CBlockFileWriter::ThreadWrite()
+{
+    WaitableLock lock(cs);
+    while (true) {
+        while (queuePending.empty() && nFlushDone == nFlushRequested && !fStop)
+            cond.wait(lock);
+
+        if (!queuePending.empty()) {
+            // The entry stays queued, and readable, until it is in the file
+            CPendingWrite write = queuePending.front();
+            lock.unlock();
+            bool fOk = false;
+            try {
+                fOk = WriteToFile(write);
+            } catch (const std::exception& e) {
+                LogPrintf("%s : %s\n", __func__, e.what());
+            }
+            lock.lock();
+
+            queuePending.pop_front();
+            mapPending[write.fUndo].erase(std::make_pair(write.pos.nFile, write.pos.nPos));
+            nPendingBytes -= write.data->size();
+            if (!fOk)
+                fFailed = true;
+            cond.notify_all();
+        } else if (nFlushDone != nFlushRequested) {
+            // Everything asked for so far is written; one fsync per file covers all of it
+            uint64_t nFlush = nFlushRequested;
+            lock.unlock();
+            CommitFiles();
+            lock.lock();
+            nFlushDone = nFlush;
+            cond.notify_all();
+        } else {
+            return;
+        }
+    }
+}
+
+bool CBlockFileWriter::Write(const CDiskBlockPos& pos, bool fUndo, std::vector<char>& vData)
+{
+    CPendingWrite write;
+    write.pos = pos;
+    write.fUndo = fUndo;
+    std::shared_ptr<std::vector<char> > data = std::make_shared<std::vector<char> >();
+    data->swap(vData);
+    write.data = data;
+    {
+        WaitableLock lock(cs);
+        // Bound the memory held by the queue; a single write larger than the bound is still accepted
+        while (!fFailed && !queuePending.empty() && nPendingBytes + write.data->size() > nMaxPendingBytes)
+            cond.wait(lock);
+        if (fFailed)
+            return false;
+        queuePending.push_back(write);
+        mapPending[fUndo][std::make_pair(pos.nFile, pos.nPos)] = write.data;
+        nPendingBytes += write.data->size();
+    }
+    cond.notify_all();
+    return true;
+}
+
+std::shared_ptr<const std::vector<char> > CBlockFileWriter::GetPending(const CDiskBlockPos& pos, bool fUndo, unsigned int& nOffset) const
+{
+    WaitableLock lock(cs);
+    const std::map<std::pair<int, unsigned int>, std::shared_ptr<const std::vector<char> > >& mapFile = mapPending[fUndo];
+    std::map<std::pair<int, unsigned int>, std::shared_ptr<const std::vector<char> > >::const_iterator it = mapFile.upper_bound(std::make_pair(pos.nFile, pos.nPos));
+    if (it == mapFile.begin())
+        return std::shared_ptr<const std::vector<char> >();
+    --it;
+    if (it->first.first != pos.nFile || pos.nPos - it->first.second >= it->second->size())
+        return std::shared_ptr<const std::vector<char> >();
+    nOffset = pos.nPos - it->first.second;
+    return it->second;
+}
+
+bool CBlockFileWriter::Flush()
+{
+    WaitableLock lock(cs);
+    uint64_t nFlush = ++nFlushRequested;
+    cond.notify_all();
+    while (nFlushDone < nFlush)
+        cond.wait(lock);
+    return !fFailed;
+}
+
+bool CBlockFileWriter::HasFailed() const
+{
+    WaitableLock lock(cs);
+    return fFailed;
+}
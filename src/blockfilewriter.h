@@ -0,0 +1,78 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEWRITER_H
+#define BITCOIN_BLOCKFILEWRITER_H
+
+#include "chain.h"
+#include "sync.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//! -blockwritequeue default (MiB)
+static const unsigned int DEFAULT_BLOCK_WRITE_QUEUE = 32;
+
+/**
+ * Appends block and undo data to the blk?????.dat and rev?????.dat files from a
+ * background thread. Positions are reserved by the caller before the data is
+ * queued, so the block index can refer to them right away:
+ * - data that is still queued is served to readers from memory
+ * - Flush writes everything queued and commits the files written to with a
+ *   single fsync each, and must be called before the block index is written
+ *   or a file is truncated
+ */
+class CBlockFileWriter
+{
+private:
+    struct CPendingWrite {
+        CDiskBlockPos pos;
+        bool fUndo;
+        std::shared_ptr<const std::vector<char> > data;
+    };
+
+    mutable CWaitableCriticalSection cs;
+    mutable CConditionVariable cond;
+    //! writes in the order they were queued; the front one may be being written
+    std::deque<CPendingWrite> queuePending;
+    //! queued data by file and position, for blk (0) and rev (1) files
+    std::map<std::pair<int, unsigned int>, std::shared_ptr<const std::vector<char> > > mapPending[2];
+    size_t nPendingBytes;
+    size_t nMaxPendingBytes;
+    //! flushes asked for and done, so that Flush waits for its own
+    uint64_t nFlushRequested;
+    uint64_t nFlushDone;
+    bool fFailed;
+    bool fStop;
+    std::thread threadWrite;
+
+    //! files written to since they were last committed, only used by the writer thread
+    std::map<std::pair<int, bool>, FILE*> mapOpenFiles;
+
+    void ThreadWrite();
+    bool WriteToFile(const CPendingWrite& write);
+    void CommitFiles();
+
+public:
+    CBlockFileWriter(size_t nMaxPendingBytesIn);
+    //! Writes and commits everything queued
+    ~CBlockFileWriter();
+
+    //! Queue vData to be written at pos, taking its contents; waits while the queue is full
+    bool Write(const CDiskBlockPos& pos, bool fUndo, std::vector<char>& vData);
+    //! Queued data containing pos, with the offset of pos in it; NULL if pos is not queued
+    std::shared_ptr<const std::vector<char> > GetPending(const CDiskBlockPos& pos, bool fUndo, unsigned int& nOffset) const;
+    //! Wait until everything queued so far is written and committed; false if a write failed
+    bool Flush();
+    //! Whether a write failed
+    bool HasFailed() const;
+};
+
+#endif // BITCOIN_BLOCKFILEWRITER_H
@@ -17,6 +17,7 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <stdexcept>
 #include <vector>
 
 
@@ -101,6 +102,96 @@ enum BlockStatus {
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 };
 
+/**
+ * Number of mints of each zerocoin denomination, in a fixed array rather than a
+ * map so that every block index entry carries it without allocating. It is
+ * serialized the way a std::map<CoinDenomination, int64_t> holding all
+ * denominations is, which keeps the block index on disk unchanged.
+ */
+class CZerocoinSupply
+{
+private:
+    static const unsigned int NUM_DENOMS = 8;
+    int64_t vSupply[NUM_DENOMS];
+
+    //! position of denom in zerocoinDenomList, or NUM_DENOMS if it is none of them
+    static unsigned int Index(libzerocoin::CoinDenomination denom)
+    {
+        switch (denom) {
+        case libzerocoin::ZQ_ONE: return 0;
+        case libzerocoin::ZQ_FIVE: return 1;
+        case libzerocoin::ZQ_TEN: return 2;
+        case libzerocoin::ZQ_FIFTY: return 3;
+        case libzerocoin::ZQ_ONE_HUNDRED: return 4;
+        case libzerocoin::ZQ_FIVE_HUNDRED: return 5;
+        case libzerocoin::ZQ_ONE_THOUSAND: return 6;
+        case libzerocoin::ZQ_FIVE_THOUSAND: return 7;
+        default: return NUM_DENOMS;
+        }
+    }
+
+public:
+    CZerocoinSupply()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        for (unsigned int i = 0; i < NUM_DENOMS; i++)
+            vSupply[i] = 0;
+    }
+
+    //! Like std::map::at, throws std::out_of_range for an invalid denomination
+    int64_t& at(libzerocoin::CoinDenomination denom)
+    {
+        unsigned int i = Index(denom);
+        if (i == NUM_DENOMS)
+            throw std::out_of_range("CZerocoinSupply::at : invalid denomination");
+        return vSupply[i];
+    }
+
+    const int64_t& at(libzerocoin::CoinDenomination denom) const
+    {
+        return const_cast<CZerocoinSupply*>(this)->at(denom);
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(NUM_DENOMS);
+        for (unsigned int i = 0; i < NUM_DENOMS; i++)
+            nSize += ::GetSerializeSize(libzerocoin::zerocoinDenomList[i], nType, nVersion) + ::GetSerializeSize(vSupply[i], nType, nVersion);
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        // zerocoinDenomList is in ascending order, the order of the map keys
+        WriteCompactSize(s, NUM_DENOMS);
+        for (unsigned int i = 0; i < NUM_DENOMS; i++) {
+            ::Serialize(s, libzerocoin::zerocoinDenomList[i], nType, nVersion);
+            ::Serialize(s, vSupply[i], nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        SetNull();
+        unsigned int nSize = ReadCompactSize(s);
+        for (unsigned int n = 0; n < nSize; n++) {
+            libzerocoin::CoinDenomination denom;
+            int64_t nSupply;
+            ::Unserialize(s, denom, nType, nVersion);
+            ::Unserialize(s, nSupply, nType, nVersion);
+            unsigned int i = Index(denom);
+            if (i != NUM_DENOMS)
+                vSupply[i] = nSupply;
+        }
+    }
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -182,7 +273,7 @@ public:
     uint32_t nSequenceId;
 
     //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
+    CZerocoinSupply zerocoinSupply;
     std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
 
     void SetNull()
@@ -216,9 +307,7 @@ public:
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(std::make_pair(denom, 0));
-        }
+        zerocoinSupply.SetNull();
         vMintDenominationsInBlock.clear();
     }
 
@@ -297,7 +386,7 @@ public:
      */
     int64_t GetZcMints(libzerocoin::CoinDenomination denom) const
     {
-        return mapZerocoinSupply.at(denom);
+        return zerocoinSupply.at(denom);
     }
 
     /**
@@ -498,7 +587,7 @@ public:
         READWRITE(nNonce);
         if(this->nVersion > 3) {
             READWRITE(nAccumulatorCheckpoint);
-            READWRITE(mapZerocoinSupply);
+            READWRITE(zerocoinSupply);
             READWRITE(vMintDenominationsInBlock);
         }
 
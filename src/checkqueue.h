@@ -5,6 +5,8 @@
 #ifndef BITCOIN_CHECKQUEUE_H
 #define BITCOIN_CHECKQUEUE_H
 
+#include "sync.h"
+
 #include <algorithm>
 #include <vector>
 
@@ -14,6 +16,8 @@
 
 template <typename T>
 class CCheckQueueControl;
+template <typename T>
+class CCheckQueueTryControl;
 
 /** 
  * Queue for verifications that have to be performed.
@@ -210,4 +214,63 @@ public:
     }
 };
 
+/**
+ * Queue for checks that are orders of magnitude more expensive than script checks, so
+ * they are handed out one at a time. Its callers run with or without cs_main held, so
+ * the queue is guarded by its own lock instead of waiting for it: a caller that finds
+ * it busy simply runs its checks inline, see CCheckQueueTryControl.
+ */
+template <typename T>
+class CSharedCheckQueue
+{
+private:
+    CCheckQueue<T> queue;
+    CCriticalSection cs;
+
+    friend class CCheckQueueTryControl<T>;
+
+public:
+    CSharedCheckQueue() : queue(1) {}
+
+    //! Worker thread
+    void Thread()
+    {
+        queue.Thread();
+    }
+};
+
+/**
+ * Controller for a CSharedCheckQueue, holding it while the checks added through it run.
+ * When the queue is busy or fEnabled is false, IsQueued() is false and the caller has to
+ * run the checks itself.
+ */
+template <typename T>
+class CCheckQueueTryControl
+{
+private:
+    CCriticalBlock lock;
+    bool fQueued;
+    CCheckQueueControl<T> control;
+
+public:
+    CCheckQueueTryControl(CSharedCheckQueue<T>& shared, bool fEnabled) : lock(fEnabled ? &shared.cs : NULL, "shared.cs", __FILE__, __LINE__, true),
+                                                                         fQueued(lock),
+                                                                         control(fQueued ? &shared.queue : NULL) {}
+
+    bool IsQueued() const
+    {
+        return fQueued;
+    }
+
+    bool Wait()
+    {
+        return control.Wait();
+    }
+
+    void Add(std::vector<T>& vChecks)
+    {
+        control.Add(vChecks);
+    }
+};
+
 #endif // BITCOIN_CHECKQUEUE_H
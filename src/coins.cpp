@@ -78,7 +78,166 @@ bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStat
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView* baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), hashBlock(0) {}
+CCoinsMap::CCoinsMap() : nNodes(0), nSize(0) {}
+
+CCoinsMap::~CCoinsMap()
+{
+    clear();
+}
+
+uint32_t CCoinsMap::NextUsed(uint32_t nNode) const
+{
+    while (nNode < nNodes) {
+        uint64_t nUsed = vChunks[nNode >> CHUNK_SHIFT]->nUsed >> (nNode & (CHUNK_NODES - 1));
+        if (nUsed == 0) {
+            // Nothing left in this chunk
+            nNode = ((nNode >> CHUNK_SHIFT) + 1) << CHUNK_SHIFT;
+            continue;
+        }
+        while (!(nUsed & 1)) {
+            nUsed >>= 1;
+            nNode++;
+        }
+        return nNode < nNodes ? nNode : NODE_NONE;
+    }
+    return NODE_NONE;
+}
+
+size_t CCoinsMap::FindSlot(const uint256& key, uint32_t nHash) const
+{
+    if (vSlots.empty())
+        return NODE_NONE;
+    size_t nMask = vSlots.size() - 1;
+    for (size_t i = nHash & nMask;; i = (i + 1) & nMask) {
+        const Slot& slot = vSlots[i];
+        if (slot.nNode == NODE_NONE)
+            return NODE_NONE;
+        if (slot.nHash == nHash && Node(slot.nNode)->first == key)
+            return i;
+    }
+}
+
+void CCoinsMap::InsertSlot(uint32_t nHash, uint32_t nNode)
+{
+    size_t nMask = vSlots.size() - 1;
+    size_t i = nHash & nMask;
+    while (vSlots[i].nNode != NODE_NONE)
+        i = (i + 1) & nMask;
+    vSlots[i].nHash = nHash;
+    vSlots[i].nNode = nNode;
+}
+
+void CCoinsMap::Reserve(size_t nCount)
+{
+    // Keep the index at most 3/4 full, so probe sequences stay short
+    size_t nSlots = vSlots.empty() ? 16 : vSlots.size();
+    while (nCount * 4 > nSlots * 3)
+        nSlots *= 2;
+    if (nSlots == vSlots.size())
+        return;
+    std::vector<Slot> vOld;
+    vOld.swap(vSlots);
+    Slot empty = {0, NODE_NONE};
+    vSlots.assign(nSlots, empty);
+    for (const Slot& slot : vOld) {
+        if (slot.nNode != NODE_NONE)
+            InsertSlot(slot.nHash, slot.nNode);
+    }
+}
+
+CCoinsMap::iterator CCoinsMap::find(const uint256& key)
+{
+    size_t i = FindSlot(key, hasher(key));
+    return iterator(this, i == NODE_NONE ? NODE_NONE : vSlots[i].nNode);
+}
+
+CCoinsMap::const_iterator CCoinsMap::find(const uint256& key) const
+{
+    size_t i = FindSlot(key, hasher(key));
+    return const_iterator(this, i == NODE_NONE ? NODE_NONE : vSlots[i].nNode);
+}
+
+std::pair<CCoinsMap::iterator, bool> CCoinsMap::insert(const value_type& value)
+{
+    uint32_t nHash = hasher(value.first);
+    size_t i = FindSlot(value.first, nHash);
+    if (i != NODE_NONE)
+        return std::make_pair(iterator(this, vSlots[i].nNode), false);
+
+    uint32_t nNode;
+    if (!vFree.empty()) {
+        nNode = vFree.back();
+        vFree.pop_back();
+    } else {
+        if (nNodes == vChunks.size() * CHUNK_NODES) {
+            Chunk* chunk = new Chunk;
+            chunk->nUsed = 0;
+            vChunks.push_back(chunk);
+        }
+        nNode = nNodes++;
+    }
+    new (Node(nNode)) value_type(value);
+    vChunks[nNode >> CHUNK_SHIFT]->nUsed |= (uint64_t)1 << (nNode & (CHUNK_NODES - 1));
+
+    Reserve(nSize + 1);
+    InsertSlot(nHash, nNode);
+    nSize++;
+    return std::make_pair(iterator(this, nNode), true);
+}
+
+void CCoinsMap::erase(const_iterator it)
+{
+    size_t nMask = vSlots.size() - 1;
+    size_t i = FindSlot(it->first, hasher(it->first));
+    assert(i != NODE_NONE && vSlots[i].nNode == it.nNode);
+
+    // Shift back the entries after the hole that could not be stored in their
+    // home slot, so that every probe sequence stays unbroken.
+    for (size_t j = (i + 1) & nMask; vSlots[j].nNode != NODE_NONE; j = (j + 1) & nMask) {
+        size_t k = vSlots[j].nHash & nMask;
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        vSlots[i] = vSlots[j];
+        i = j;
+    }
+    vSlots[i].nNode = NODE_NONE;
+
+    Node(it.nNode)->~value_type();
+    vChunks[it.nNode >> CHUNK_SHIFT]->nUsed &= ~((uint64_t)1 << (it.nNode & (CHUNK_NODES - 1)));
+    vFree.push_back(it.nNode);
+    nSize--;
+}
+
+void CCoinsMap::clear()
+{
+    for (uint32_t nNode = NextUsed(0); nNode != NODE_NONE; nNode = NextUsed(nNode + 1))
+        Node(nNode)->~value_type();
+    for (Chunk* chunk : vChunks)
+        delete chunk;
+    std::vector<Chunk*>().swap(vChunks);
+    std::vector<uint32_t>().swap(vFree);
+    std::vector<Slot>().swap(vSlots);
+    nNodes = 0;
+    nSize = 0;
+}
+
+void CCoinsMap::swap(CCoinsMap& other)
+{
+    std::swap(hasher, other.hasher);
+    vChunks.swap(other.vChunks);
+    std::swap(nNodes, other.nNodes);
+    vFree.swap(other.vFree);
+    vSlots.swap(other.vSlots);
+    std::swap(nSize, other.nSize);
+}
+
+size_t CCoinsMap::DynamicMemoryUsage() const
+{
+    return vChunks.size() * memusage::MallocUsage(sizeof(Chunk)) + memusage::DynamicUsage(vChunks) +
+           memusage::DynamicUsage(vFree) + memusage::DynamicUsage(vSlots);
+}
+
+CCoinsViewCache::CCoinsViewCache(CCoinsView* baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), hashBlock(0), cachedCoinsUsage(0) {}
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -95,11 +254,13 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256& txid) const
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
     tmp.swap(ret->second.coins);
+    ret->second.SetFetched();
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
+    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
     return ret;
 }
 
@@ -117,6 +278,7 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256& txid)
 {
     assert(!hasModifier);
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    size_t cachedCoinUsage = 0;
     if (ret.second) {
         if (!base->GetCoins(txid, ret.first->second.coins)) {
             // The parent view does not have this entry; mark it as fresh.
@@ -125,11 +287,15 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256& txid)
         } else if (ret.first->second.coins.IsPruned()) {
             // The parent view only has a pruned entry for this; mark it as fresh.
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
+        } else {
+            ret.first->second.SetFetched();
         }
+    } else {
+        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first);
+    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
 const CCoins* CCoinsViewCache::AccessCoins(const uint256& txid) const
@@ -152,6 +318,14 @@ bool CCoinsViewCache::HaveCoins(const uint256& txid) const
     return (it != cacheCoins.end() && !it->second.coins.vout.empty());
 }
 
+bool CCoinsViewCache::HaveCoinsUncached(const uint256& txid) const
+{
+    CCoinsMap::const_iterator it = cacheCoins.find(txid);
+    if (it != cacheCoins.end())
+        return !it->second.coins.vout.empty();
+    return base->HaveCoins(txid);
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const
 {
     if (hashBlock == uint256(0))
@@ -179,6 +353,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
                     assert(it->second.flags & CCoinsCacheEntry::FRESH);
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
+                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
                 }
             } else {
@@ -186,10 +361,13 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
+                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
                     cacheCoins.erase(itUs);
                 } else {
                     // A normal modification.
+                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
+                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 }
             }
@@ -205,6 +383,7 @@ bool CCoinsViewCache::Flush()
 {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
+    cachedCoinsUsage = 0;
     return fOk;
 }
 
@@ -213,6 +392,11 @@ unsigned int CCoinsViewCache::GetCacheSize() const
     return cacheCoins.size();
 }
 
+size_t CCoinsViewCache::DynamicMemoryUsage() const
+{
+    return cacheCoins.DynamicMemoryUsage() + cachedCoinsUsage;
+}
+
 const CTxOut& CCoinsViewCache::GetOutputFor(const CTxIn& input) const
 {
     const CCoins* coins = AccessCoins(input.prevout.hash);
@@ -266,7 +450,7 @@ double CCoinsViewCache::GetPriority(const CTransaction& tx, int nHeight) const
     return tx.ComputePriority(dResult);
 }
 
-CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_) : cache(cache_), it(it_)
+CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage)
 {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
@@ -277,7 +461,11 @@ CCoinsModifier::~CCoinsModifier()
     assert(cache.hasModifier);
     cache.hasModifier = false;
     it->second.coins.Cleanup();
+    cache.cachedCoinsUsage -= cachedCoinUsage; // Subtract the old usage
     if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
         cache.cacheCoins.erase(it);
+    } else {
+        // If the coin still exists after the modification, add the new usage
+        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
     }
 }
@@ -8,6 +8,7 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "memusage.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -16,7 +17,9 @@
 #include <assert.h>
 #include <stdint.h>
 
-#include <boost/unordered_map.hpp>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 /** 
 
@@ -283,6 +286,15 @@ public:
                 return false;
         return true;
     }
+
+    //! heap memory owned by this object: the outputs and their scripts
+    size_t DynamicMemoryUsage() const
+    {
+        size_t ret = memusage::DynamicUsage(vout);
+        for (const CTxOut& out : vout)
+            ret += memusage::DynamicUsage(out.scriptPubKey);
+        return ret;
+    }
 };
 
 class CCoinsKeyHasher
@@ -293,12 +305,8 @@ private:
 public:
     CCoinsKeyHasher();
 
-    /**
-     * This *must* return size_t. With Boost 1.46 on 32-bit systems the
-     * unordered_map will behave unpredictably if the custom hasher returns a
-     * uint64_t, resulting in failures when syncing the chain (#4634).
-     */
-    size_t operator()(const uint256& key) const
+    //! Salted, so that peers can't pick txids that all land in the same part of the table
+    uint64_t operator()(const uint256& key) const
     {
         return key.GetHash(salt);
     }
@@ -313,10 +321,166 @@ struct CCoinsCacheEntry {
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
     };
 
-    CCoinsCacheEntry() : coins(), flags(0) {}
+    /**
+     * The outputs the parent view had when the entry was fetched from it:
+     * their number, and which of the first 64 were unspent. This lets a
+     * parent that stores outputs separately write only the changed ones.
+     */
+    uint32_t nFetchedOutputs;
+    uint64_t nFetchedAvail;
+
+    CCoinsCacheEntry() : coins(), flags(0), nFetchedOutputs(0), nFetchedAvail(0) {}
+
+    //! Record the current outputs as those of the parent view
+    void SetFetched()
+    {
+        nFetchedOutputs = coins.vout.size();
+        nFetchedAvail = 0;
+        for (unsigned int i = 0; i < coins.vout.size() && i < 64; i++) {
+            if (!coins.vout[i].IsNull())
+                nFetchedAvail |= (uint64_t)1 << i;
+        }
+    }
+
+    //! Whether the parent view had output n unspent, or may have had it beyond the first 64
+    bool MayHaveFetched(unsigned int n) const
+    {
+        return n < nFetchedOutputs && (n >= 64 || ((nFetchedAvail >> n) & 1));
+    }
+
+    //! Whether the parent view is known to have had output n unspent
+    bool HasFetched(unsigned int n) const
+    {
+        return n < 64 && n < nFetchedOutputs && ((nFetchedAvail >> n) & 1);
+    }
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+/**
+ * Hash table of cache entries keyed by txid, with the subset of the
+ * unordered_map interface the coins views use.
+ *
+ * Entries are allocated from fixed-size chunks that are never moved, so
+ * pointers and iterators to an entry stay valid until that entry itself is
+ * erased, also across inserts. Lookups go through a separate open-addressing
+ * index (linear probing) that holds a 32-bit hash and the node number of
+ * each entry, and that is the only part rebuilt when the table grows.
+ * Iteration walks the chunks in allocation order.
+ */
+class CCoinsMap
+{
+public:
+    typedef std::pair<const uint256, CCoinsCacheEntry> value_type;
+
+private:
+    static const unsigned int CHUNK_SHIFT = 6;
+    static const uint32_t CHUNK_NODES = 1 << CHUNK_SHIFT;
+    static const uint32_t NODE_NONE = 0xffffffff;
+
+    struct Chunk {
+        //! bit i is set when nodes[i] holds an entry
+        uint64_t nUsed;
+        typename std::aligned_storage<sizeof(value_type), std::alignment_of<value_type>::value>::type nodes[CHUNK_NODES];
+    };
+
+    struct Slot {
+        uint32_t nHash;
+        uint32_t nNode;
+    };
+
+    CCoinsKeyHasher hasher;
+    //! the entries, nNodes of which have been handed out
+    std::vector<Chunk*> vChunks;
+    uint32_t nNodes;
+    //! nodes below nNodes that were erased and can be reused
+    std::vector<uint32_t> vFree;
+    //! the index, empty or a power of two in size
+    std::vector<Slot> vSlots;
+    size_t nSize;
+
+    value_type* Node(uint32_t nNode) const
+    {
+        return reinterpret_cast<value_type*>(&vChunks[nNode >> CHUNK_SHIFT]->nodes[nNode & (CHUNK_NODES - 1)]);
+    }
+    uint32_t NextUsed(uint32_t nNode) const;
+    size_t FindSlot(const uint256& key, uint32_t nHash) const;
+    void InsertSlot(uint32_t nHash, uint32_t nNode);
+    void Reserve(size_t nCount);
+
+    CCoinsMap(const CCoinsMap&);
+    CCoinsMap& operator=(const CCoinsMap&);
+
+public:
+    class const_iterator
+    {
+    protected:
+        const CCoinsMap* map;
+        uint32_t nNode;
+
+    public:
+        const_iterator() : map(NULL), nNode(NODE_NONE) {}
+        const_iterator(const CCoinsMap* mapIn, uint32_t nNodeIn) : map(mapIn), nNode(nNodeIn) {}
+        const value_type& operator*() const { return *map->Node(nNode); }
+        const value_type* operator->() const { return map->Node(nNode); }
+        const_iterator& operator++()
+        {
+            nNode = map->NextUsed(nNode + 1);
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(const const_iterator& other) const { return nNode == other.nNode; }
+        bool operator!=(const const_iterator& other) const { return nNode != other.nNode; }
+        friend class CCoinsMap;
+    };
+
+    class iterator : public const_iterator
+    {
+    public:
+        iterator() {}
+        iterator(const CCoinsMap* mapIn, uint32_t nNodeIn) : const_iterator(mapIn, nNodeIn) {}
+        value_type& operator*() const { return *this->map->Node(this->nNode); }
+        value_type* operator->() const { return this->map->Node(this->nNode); }
+        iterator& operator++()
+        {
+            const_iterator::operator++();
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+    };
+
+    CCoinsMap();
+    ~CCoinsMap();
+
+    iterator begin() { return iterator(this, NextUsed(0)); }
+    const_iterator begin() const { return const_iterator(this, NextUsed(0)); }
+    iterator end() { return iterator(this, NODE_NONE); }
+    const_iterator end() const { return const_iterator(this, NODE_NONE); }
+
+    iterator find(const uint256& key);
+    const_iterator find(const uint256& key) const;
+    std::pair<iterator, bool> insert(const value_type& value);
+    CCoinsCacheEntry& operator[](const uint256& key) { return insert(value_type(key, CCoinsCacheEntry())).first->second; }
+    //! Erase one entry; iterators to the other entries stay valid
+    void erase(const_iterator it);
+    //! Erase all entries and release the memory
+    void clear();
+    void swap(CCoinsMap& other);
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    //! Memory allocated by the table, excluding the heap memory owned by the entries
+    size_t DynamicMemoryUsage() const;
+};
 
 struct CCoinsStats {
     int nHeight;
@@ -398,7 +562,8 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_);
+    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
     CCoins* operator->() { return &it->second.coins; }
@@ -421,6 +586,9 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /* Cached dynamic memory usage for the inner CCoins objects. */
+    mutable size_t cachedCoinsUsage;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -432,6 +600,9 @@ public:
     void SetBestBlock(const uint256& hashBlock);
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
 
+    //! HaveCoins that asks the base view without adding its answer to the cache
+    bool HaveCoinsUncached(const uint256& txid) const;
+
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
      * more efficient than GetCoins. Modifications to other cache entries are
@@ -456,6 +627,9 @@ public:
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
+    //! Calculate the size of the cache (in bytes)
+    size_t DynamicMemoryUsage() const;
+
     /** 
      * Amount of NZR coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -0,0 +1,112 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstats.h"
+
+#include "clientversion.h"
+#include "compressor.h"
+#include "crypto/common.h"
+#include "crypto/sha512.h"
+#include "hash.h"
+#include "primitives/transaction.h"
+#include "streams.h"
+
+static const unsigned int MUHASH_BITS = 3072;
+
+static const CBigNum& MuHashModulus()
+{
+    static const CBigNum modulus((CBigNum(1) << MUHASH_BITS) - CBigNum(1103717));
+    return modulus;
+}
+
+CMuHash::CMuHash() : numerator(1), denominator(1) {}
+
+CBigNum CMuHash::ToNum(const std::vector<unsigned char>& vch)
+{
+    // Expand the SHA256 of the element to MUHASH_BITS bits, little endian, with
+    // a trailing zero byte to keep the number positive
+    uint256 hashElement = Hash(vch.begin(), vch.end());
+    std::vector<unsigned char> vchNum(MUHASH_BITS / 8 + 1, 0);
+    for (uint32_t i = 0; i < MUHASH_BITS / 512; i++) {
+        unsigned char pchIndex[4];
+        WriteLE32(pchIndex, i);
+        CSHA512().Write(hashElement.begin(), 32).Write(pchIndex, 4).Finalize(&vchNum[i * CSHA512::OUTPUT_SIZE]);
+    }
+    return CBigNum(vchNum) % MuHashModulus();
+}
+
+void CMuHash::Insert(const std::vector<unsigned char>& vch)
+{
+    numerator = numerator.mul_mod(ToNum(vch), MuHashModulus());
+}
+
+void CMuHash::Remove(const std::vector<unsigned char>& vch)
+{
+    denominator = denominator.mul_mod(ToNum(vch), MuHashModulus());
+}
+
+CMuHash& CMuHash::operator*=(const CMuHash& other)
+{
+    numerator = numerator.mul_mod(other.numerator, MuHashModulus());
+    denominator = denominator.mul_mod(other.denominator, MuHashModulus());
+    return *this;
+}
+
+uint256 CMuHash::Finalize() const
+{
+    const CBigNum& modulus = MuHashModulus();
+    CBigNum value = numerator.mul_mod(denominator.inverse(modulus), modulus);
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << value;
+    return ss.GetHash();
+}
+
+//! The set element of an unspent output, as used for the hash and the serialized size
+static std::vector<unsigned char> CoinElement(const COutPoint& outpoint, const CCoins& coins, const CTxOut& out)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    unsigned int nCode = coins.nHeight * 2 + (coins.fCoinBase ? 1 : 0);
+    ss << outpoint;
+    ss << VARINT(nCode);
+    ss << CTxOutCompressor(REF(out));
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+void CCoinsRunningStats::AddOutput(const COutPoint& outpoint, const CCoins& coins, const CTxOut& out)
+{
+    std::vector<unsigned char> vch = CoinElement(outpoint, coins, out);
+    hash.Insert(vch);
+    nTransactionOutputs++;
+    nSerializedSize += vch.size();
+    nTotalAmount += out.nValue;
+}
+
+void CCoinsRunningStats::RemoveOutput(const COutPoint& outpoint, const CCoins& coins, const CTxOut& out)
+{
+    std::vector<unsigned char> vch = CoinElement(outpoint, coins, out);
+    hash.Remove(vch);
+    nTransactionOutputs--;
+    nSerializedSize -= vch.size();
+    nTotalAmount -= out.nValue;
+}
+
+void CCoinsRunningStats::Apply(const CCoinsRunningStats& delta)
+{
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nSerializedSize += delta.nSerializedSize;
+    nTotalAmount += delta.nTotalAmount;
+    hash *= delta.hash;
+}
+
+void CCoinsRunningStats::GetStats(CCoinsStats& stats) const
+{
+    stats.nHeight = nHeight;
+    stats.hashBlock = hashBlock;
+    stats.nTransactions = nTransactions;
+    stats.nTransactionOutputs = nTransactionOutputs;
+    stats.nSerializedSize = nSerializedSize;
+    stats.hashSerialized = hash.Finalize();
+    stats.nTotalAmount = nTotalAmount;
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include "amount.h"
+#include "coins.h"
+#include "libzerocoin/bignum.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+class COutPoint;
+class CTxOut;
+
+/**
+ * A hash of a set of byte strings that can be updated as elements are added
+ * and removed, independent of their order (MuHash). Every element is mapped to
+ * a number modulo the prime 2^3072 - 1103717; the set is represented by the
+ * product of the added ones over the product of the removed ones.
+ */
+class CMuHash
+{
+private:
+    CBigNum numerator;
+    CBigNum denominator;
+
+    static CBigNum ToNum(const std::vector<unsigned char>& vch);
+
+public:
+    CMuHash();
+
+    void Insert(const std::vector<unsigned char>& vch);
+    void Remove(const std::vector<unsigned char>& vch);
+    //! Add the elements added to and remove the elements removed from other
+    CMuHash& operator*=(const CMuHash& other);
+
+    //! The hash of the set
+    uint256 Finalize() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+/**
+ * Statistics of the unspent output set that are kept up to date as blocks are
+ * connected and disconnected, or the change they make to them. Outputs are
+ * identified by their outpoint, height, coinbase flag and txout, the fields
+ * that the block undo data restores.
+ */
+class CCoinsRunningStats
+{
+public:
+    uint256 hashBlock;
+    int nHeight;
+    int64_t nTransactions;
+    int64_t nTransactionOutputs;
+    int64_t nSerializedSize;
+    CAmount nTotalAmount;
+    CMuHash hash;
+
+    CCoinsRunningStats() : hashBlock(0), nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    void AddOutput(const COutPoint& outpoint, const CCoins& coins, const CTxOut& out);
+    void RemoveOutput(const COutPoint& outpoint, const CCoins& coins, const CTxOut& out);
+    //! Apply the changes recorded in delta
+    void Apply(const CCoinsRunningStats& delta);
+
+    void GetStats(CCoinsStats& stats) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(hash);
+    }
+};
+
+#endif // BITCOIN_COINSTATS_H
@@ -313,6 +313,25 @@ uint256 SerializeHash(const T& obj, int nType = SER_GETHASH, int nVersion = PROT
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/** SipHash-2-4, keyed with k0 and k1 */
+class CSipHasher
+{
+private:
+    uint64_t v[4];
+    uint64_t tmp;
+    int count;
+
+public:
+    CSipHasher(uint64_t k0, uint64_t k1);
+    //! Hash a 64-bit integer; only valid while the bytes written so far are a multiple of 8
+    CSipHasher& Write(uint64_t data);
+    CSipHasher& Write(const unsigned char* data, size_t size);
+    uint64_t Finalize() const;
+};
+
+/** SipHash-2-4 of a 256-bit value, without the overhead of the generic CSipHasher */
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+
 void BIP32Hash(const ChainCode chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
 //int HMAC_SHA512_Init(HMAC_SHA512_CTX *pctx, const void *pkey, size_t len);
@@ -17,6 +17,9 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockcache.h"
+#include "blockfilemap.h"
+#include "blockfilewriter.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "httpserver.h"
@@ -28,6 +31,7 @@
 #include "masternode-payments.h"
 #include "masternodeconfig.h"
 #include "masternodeman.h"
+#include "messageworkers.h"
 #include "miner.h"
 #include "net.h"
 #include "rpc/server.h"
@@ -167,7 +171,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB* pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher* pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -204,8 +207,10 @@ void PrepareShutdown()
     StopRPC();
     StopHTTPServer();
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
+    if (pwalletMain) {
+        pwalletMain->StopZerocoinWitnessThread();
         bitdb.Flush(false);
+    }
     GenerateBitcoins(false, NULL, 0);
 #endif
     StopNode();
@@ -219,6 +224,10 @@ void PrepareShutdown()
     threadGroup.interrupt_all();
     threadGroup.join_all();
 
+    // Nothing queues messages any more once the message handler has stopped
+    delete pmessageWorkers;
+    pmessageWorkers = NULL;
+
     if (fFeeEstimatesInitialized) {
         boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
         CAutoFile est_fileout(fopen(est_path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
@@ -237,8 +246,13 @@ void PrepareShutdown()
             //record that client took the proper shutdown procedure
             pblocktree->WriteFlag("shutdown", true);
         }
+        InitCoinsStats(NULL, CCoinsRunningStats());
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsWriter;
+        pcoinsWriter = NULL;
+        delete pblockWriter;
+        pblockWriter = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -379,8 +393,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-backgroundflush", strprintf(_("Write the chainstate to disk from a separate thread when the coin cache is full (default: %u)"), DEFAULT_BACKGROUND_FLUSH));
+    strUsage += HelpMessageOpt("-blockcachesize=<n>", strprintf(_("Keep up to <n> MiB of recently used decoded blocks in memory (0 to disable, default: %u)"), DEFAULT_BLOCK_CACHE_SIZE));
+    strUsage += HelpMessageOpt("-blockmmap", strprintf(_("Read blocks from finalized block files through memory mappings (default: %u)"), DEFAULT_BLOCK_MMAP));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-blocksizenotify=<cmd>", _("Execute command when the best block changes and its size is over (%s in cmd is replaced by block hash, %d with the block size)"));
+    strUsage += HelpMessageOpt("-blockwritequeue=<n>", strprintf(_("Write blocks and undo data from a separate thread, queueing up to <n> MiB (0 = write synchronously, default: %u)"), DEFAULT_BLOCK_WRITE_QUEUE));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "nodezero.conf"));
     if (mode == HMM_BITCOIND) {
@@ -390,6 +408,8 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbtune=<db>.<option>=<n>", _("Tune the LevelDB options of database <db> (blockindex, chainstate or zerocoin): cache and writebuffer in MiB, "
+            "bloombits per key (0 = no bloom filter), compression (0/1) and maxopenfiles. Can be specified multiple times"));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -397,6 +417,10 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "nodezerod.pid"));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables support for serving "
+            "old blocks to peers and requires a reindex to be undone. Blocks that are still needed for unspent outputs, "
+            "zerocoin spends or budget collateral are kept. Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexaccumulators", _("Reindex the accumulator database") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexmoneysupply", _("Reindex the NZR and zNZR money supply statistics") + " " + _("on startup"));
@@ -412,6 +436,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), 86400));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-compactblocks", strprintf(_("Relay new blocks to and from peers as short transaction ids, rebuilt from the mempool (default: %u)"), DEFAULT_COMPACT_BLOCKS));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP address (default: 1 when listening and no -externalip)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + _("(default: 1)"));
@@ -423,6 +448,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), 125));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000));
+    strUsage += HelpMessageOpt("-msgthreads=<n>", strprintf(_("Process masternode, budget and payment messages with <n> threads besides the message handler, 0 to process them on the message handler (0 to %d, default: %d)"), MAX_MESSAGE_THREADS, DEFAULT_MESSAGE_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), 1));
@@ -432,6 +458,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), 1));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+#ifdef HAVE_SYS_EPOLL_H
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Wait for socket events with <mode>, epoll or select; select limits connections to FD_SETSIZE (default: %s)"), DEFAULT_SOCKETEVENTS));
+#endif
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -519,6 +548,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> entries (default: %u)"), 50000));
+        strUsage += HelpMessageOpt("-maxzcspendcachesize=<n>", strprintf(_("Limit size of zerocoin spend verification cache to <n> entries (default: %u)"), DEFAULT_MAX_ZC_SPEND_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in NZR/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -654,6 +684,47 @@ struct CImportingNow {
     }
 };
 
+// If we're using -prune with -reindex, then delete block files that will be ignored by the
+// reindex.  Since reindexing works by starting at block file 0 and looping until a blockfile
+// is missing, do the same here to delete any later block files after a gap.  Also delete all
+// rev files since they'll be rewritten by the reindex anyway.  This ensures that vinfoBlockFile
+// is in sync with what's actually on disk by the time we start downloading, so that pruning
+// works correctly.
+void CleanupBlockRevFiles()
+{
+    using namespace boost::filesystem;
+    std::map<std::string, path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    path blocksdir = GetDataDir() / "blocks";
+    for (directory_iterator it(blocksdir); it != directory_iterator(); it++) {
+        if (is_regular_file(*it) &&
+            it->path().filename().string().length() == 12 &&
+            it->path().filename().string().substr(8, 4) == ".dat") {
+            if (it->path().filename().string().substr(0, 3) == "blk")
+                mapBlockFiles[it->path().filename().string().substr(3, 5)] = it->path();
+            else if (it->path().filename().string().substr(0, 3) == "rev")
+                remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter.  Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const std::pair<const std::string, path>& item : mapBlockFiles) {
+        if (atoi(item.first) == nContigCounter) {
+            nContigCounter++;
+            continue;
+        }
+        remove(item.second);
+    }
+}
+
 void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
 {
     RenameThread("nodezero-loadblk");
@@ -883,10 +954,17 @@ bool AppInit2()
         }
     }
 
+    std::string strSocketEvents = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (!ParseSocketEventsMode(strSocketEvents, nSocketEventsMode))
+        return InitError(strprintf(_("Unsupported -socketevents mode: '%s'"), strSocketEvents));
+
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", 125);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // Only select() is bound by FD_SETSIZE
+    if (nSocketEventsMode == SOCKETEVENTS_SELECT)
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -920,6 +998,23 @@ bool AppInit2()
     // Checkmempool and checkblockindex default to true in regtest mode
     mempool.setSanityCheck(GetBoolArg("-checkmempool", Params().DefaultConsistencyChecks()));
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
+    fBlockMmap = GetBoolArg("-blockmmap", DEFAULT_BLOCK_MMAP);
+
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files.
+    // The transaction index stays enabled: transactions of blocks that are kept are still
+    // looked up through it, and the blocks of pruned ones are not needed anymore.
+    int64_t nSignedPruneTarget = GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0) {
+        return InitError(_("Prune cannot be configured with a negative value."));
+    }
+    nPruneTarget = (uint64_t)nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
+            return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        }
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
@@ -1019,6 +1114,13 @@ bool AppInit2()
 
     }
 
+    if (GetBoolArg("-compactblocks", DEFAULT_COMPACT_BLOCKS))
+        nLocalServices |= NODE_COMPACT_BLOCKS;
+
+    // Pruned nodes cannot serve the full block chain
+    if (fPruneMode)
+        nLocalServices &= ~NODE_NETWORK;
+
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
@@ -1068,8 +1170,11 @@ bool AppInit2()
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadZerocoinSpendCheck);
+            threadGroup.create_thread(&ThreadAccumulatorCheck);
+        }
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1401,16 +1506,40 @@ bool AppInit2()
         nTotalCache = (nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     else if (nTotalCache > (nMaxDbCache << 20))
         nTotalCache = (nMaxDbCache << 20); // total cache cannot be greater than nMaxDbCache
+    // per database LevelDB options; a cache size given there replaces the database's share,
+    // but never takes more than half of what is left of -dbcache
+    std::map<std::string, CLevelDBTuning> mapDBTuning;
+    mapDBTuning["blockindex"];
+    mapDBTuning["chainstate"];
+    mapDBTuning["zerocoin"];
+    std::string strTuningError;
+    if (!ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapDBTuning, strTuningError))
+        return InitError(strTuningError);
     size_t nBlockTreeDBCache = nTotalCache / 8;
     if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
+    if (mapDBTuning["blockindex"].nCacheSize)
+        nBlockTreeDBCache = std::min(mapDBTuning["blockindex"].nCacheSize, nTotalCache / 2);
     nTotalCache -= nBlockTreeDBCache;
+    size_t nZerocoinDBCache = nTotalCache / 16;
+    if (mapDBTuning["zerocoin"].nCacheSize)
+        nZerocoinDBCache = std::min(mapDBTuning["zerocoin"].nCacheSize, nTotalCache / 2);
+    nTotalCache -= nZerocoinDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
+    if (mapDBTuning["chainstate"].nCacheSize)
+        nCoinDBCache = std::min(mapDBTuning["chainstate"].nCacheSize, nTotalCache / 2);
     nTotalCache -= nCoinDBCache;
-    nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
+    nCoinCacheUsage = nTotalCache;
+    LogPrintf("Cache configuration: block index %.1fMiB, zerocoin %.1fMiB, chainstate %.1fMiB, in-memory UTXO set %.1fMiB\n",
+        nBlockTreeDBCache * (1.0 / 1024 / 1024), nZerocoinDBCache * (1.0 / 1024 / 1024), nCoinDBCache * (1.0 / 1024 / 1024), nCoinCacheUsage * (1.0 / 1024 / 1024));
+    blockCache.SetMaxUsage(std::max((int64_t)0, GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE)) << 20);
+
+    int64_t nBlockWriteQueue = GetArg("-blockwritequeue", DEFAULT_BLOCK_WRITE_QUEUE);
+    if (nBlockWriteQueue > 0)
+        pblockWriter = new CBlockFileWriter(nBlockWriteQueue << 20);
 
     bool fLoaded = false;
-    while (!fLoaded) {
+    while (!fLoaded && !fRequestShutdown) {
         bool fReset = fReindex;
         std::string strLoadError;
 
@@ -1420,7 +1549,10 @@ bool AppInit2()
         do {
             try {
                 UnloadBlockIndex();
+                InitCoinsStats(NULL, CCoinsRunningStats());
                 delete pcoinsTip;
+                delete pcoinsWriter;
+                pcoinsWriter = NULL;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
@@ -1428,16 +1560,34 @@ bool AppInit2()
                 delete pSporkDB;
 
                 //NodeZero specific: zerocoin and spork DB's
-                zerocoinDB = new CZerocoinDB(0, false, fReindex);
+                zerocoinDB = new CZerocoinDB(nZerocoinDBCache, false, fReindex, mapDBTuning["zerocoin"]);
                 pSporkDB = new CSporkDB(0, false, false);
 
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
+                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, mapDBTuning["blockindex"]);
+                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex, mapDBTuning["chainstate"]);
+
+                // Convert a chainstate in the one record per transaction format; resumes if interrupted
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+                if (fRequestShutdown)
+                    break;
+
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                if (GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH)) {
+                    pcoinsWriter = new CCoinsViewAsyncWriter(pcoinscatcher);
+                    pcoinsTip = new CCoinsViewCache(pcoinsWriter);
+                } else {
+                    pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                }
 
-                if (fReindex)
+                if (fReindex) {
                     pblocktree->WriteReindexing(true);
+                    //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
+                    if (fPruneMode)
+                        CleanupBlockRevFiles();
+                }
 
                 // NodeZero: load previous sessions sporks if we have them.
                 uiInterface.InitMessage(_("Loading sporks..."));
@@ -1456,6 +1606,18 @@ bool AppInit2()
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(Params().HashGenesisBlock()) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
+                // UTXO set statistics are kept up to date from here on; compute them if they
+                // were not written with the chainstate (older version or unclean shutdown)
+                CCoinsRunningStats coinsStats;
+                if (!pcoinsdbview->ReadRunningStats(coinsStats)) {
+                    uiInterface.InitMessage(_("Computing UTXO set statistics..."));
+                    if (!pcoinsdbview->ComputeRunningStats(coinsStats)) {
+                        strLoadError = _("Error reading from database");
+                        break;
+                    }
+                }
+                InitCoinsStats(pcoinsdbview, coinsStats);
+
                 // Initialize the block index (no-op if non-empty database was already loaded)
                 if (!InitBlockIndex()) {
                     strLoadError = _("Error initializing block database");
@@ -1468,12 +1630,22 @@ bool AppInit2()
                     break;
                 }
 
+                // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
+                    break;
+                }
+
                 // Populate list of invalid/fraudulent outpoints that are banned from the chain
                 invalid_out::LoadOutpoints();
                 invalid_out::LoadSerials();
 
-                // Drop all information from the zerocoinDB and repopulate
-                if (GetBoolArg("-reindexzerocoin", false)) {
+                // Drop all information from the zerocoinDB and repopulate, or finish an interrupted repopulation
+                int nHeightReindexZerocoin;
+                if (GetBoolArg("-reindexzerocoin", false) || zerocoinDB->ReadReindexProgress(nHeightReindexZerocoin)) {
+                    if (fHavePruned)
+                        return InitError(_("Reindexing the zerocoin database reads all blocks; it is not supported in prune mode, use -reindex instead"));
                     if (chainActive.Height() > Params().Zerocoin_StartHeight()) {
                         uiInterface.InitMessage(_("Reindexing zerocoin database..."));
                         std::string strError = ReindexZerocoinDB();
@@ -1506,6 +1678,10 @@ bool AppInit2()
 
                 }
 
+                // The recalculations below read every block since the zerocoin activation
+                if (fHavePruned && (reindexDueWrappedSerials || reindexZerocoin || GetBoolArg("-reindexmoneysupply", false) || GetBoolArg("-reindexaccumulators", false)))
+                    return InitError(_("Recalculating the zerocoin supply or accumulators reads all blocks; it is not supported in prune mode, use -reindex instead"));
+
                 // Reindex only for wrapped serials inflation.
                 if (reindexDueWrappedSerials)
                     AddWrappedSerialsInflation();
@@ -1569,7 +1745,7 @@ bool AppInit2()
                     }
 
                     // Zerocoin must check at level 4
-                    if (!CVerifyDB().VerifyDB(pcoinsdbview, 4, GetArg("-checkblocks", 100))) {
+                    if (!CVerifyDB().VerifyDB(pcoinsWriter ? (CCoinsView*)pcoinsWriter : pcoinsdbview, 4, GetArg("-checkblocks", 100))) {
                         strLoadError = _("Corrupted block database detected");
                         fVerifyingBlocks = false;
                         break;
@@ -1586,7 +1762,7 @@ bool AppInit2()
             fLoaded = true;
         } while (false);
 
-        if (!fLoaded) {
+        if (!fLoaded && !fRequestShutdown) {
             // first suggest a reindex
             if (!fReset) {
                 bool fRet = uiInterface.ThreadSafeMessageBox(
@@ -1764,6 +1940,14 @@ bool AppInit2()
 #endif // !ENABLE_WALLET
     // ********************************************************* Step 9: import blocks
 
+    // if pruning, unset the service bit and perform the initial blockstore prune
+    // after any wallet rescanning has taken place.
+    if (fPruneMode) {
+        uiInterface.InitMessage(_("Pruning blockstore..."));
+        if (!fReindex)
+            PruneAndFlush();
+    }
+
     if (mapArgs.count("-blocknotify"))
         uiInterface.NotifyBlockTip.connect(BlockNotifyCallback);
 
@@ -1960,6 +2144,12 @@ bool AppInit2()
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup);
 
+    int nMessageThreads = std::max(0, std::min((int)GetArg("-msgthreads", DEFAULT_MESSAGE_THREADS), MAX_MESSAGE_THREADS));
+    if (nMessageThreads > 0) {
+        LogPrintf("Using %d threads for masternode, budget and payment messages\n", nMessageThreads);
+        pmessageWorkers = new CMessageWorkers(nMessageThreads);
+    }
+
     StartNode(threadGroup, scheduler);
 
     if (nLocalServices & NODE_BLOOM_LIGHT_ZC) {
@@ -1986,6 +2176,9 @@ bool AppInit2()
         // Run a thread to flush wallet periodically
         threadGroup.create_thread(boost::bind(&ThreadFlushWalletDB, boost::ref(pwalletMain->strWalletFile)));
 
+        // Keep the zerocoin witnesses current as new blocks arrive
+        pwalletMain->StartZerocoinWitnessThread();
+
         if (GetBoolArg("-precompute", false)) {
             // Run a thread to precompute any zNZR spends
             threadGroup.create_thread(boost::bind(&ThreadPrecomputeSpends));
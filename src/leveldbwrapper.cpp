@@ -5,6 +5,7 @@
 #include "leveldbwrapper.h"
 
 #include "util.h"
+#include "utilstrencodings.h"
 
 #include <boost/filesystem.hpp>
 
@@ -27,14 +28,54 @@ void HandleError(const leveldb::Status& status)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+bool ParseLevelDBTuning(const std::vector<std::string>& vArgs, std::map<std::string, CLevelDBTuning>& mapTuning, std::string& strError)
+{
+    for (const std::string& strArg : vArgs) {
+        size_t nDot = strArg.find('.');
+        size_t nEquals = strArg.find('=');
+        int64_t n;
+        if (nDot == std::string::npos || nEquals == std::string::npos || nDot > nEquals || !ParseInt64(strArg.substr(nEquals + 1), &n) || n < 0) {
+            strError = strprintf("Invalid -dbtune argument '%s', expected <database>.<option>=<n>", strArg);
+            return false;
+        }
+        std::string strDB = strArg.substr(0, nDot);
+        std::string strOption = strArg.substr(nDot + 1, nEquals - nDot - 1);
+        if (!mapTuning.count(strDB)) {
+            strError = strprintf("Unknown database '%s' in -dbtune argument '%s'", strDB, strArg);
+            return false;
+        }
+        CLevelDBTuning& tuning = mapTuning[strDB];
+        if ((strOption == "cache" || strOption == "writebuffer") && n > MAX_LEVELDB_TUNING_SIZE) {
+            strError = strprintf("Size in -dbtune argument '%s' exceeds the maximum of %d MiB", strArg, MAX_LEVELDB_TUNING_SIZE);
+            return false;
+        }
+        if (strOption == "cache") {
+            tuning.nCacheSize = n << 20;
+        } else if (strOption == "writebuffer") {
+            tuning.nWriteBufferSize = n << 20;
+        } else if (strOption == "bloombits") {
+            tuning.nBloomBits = std::min(n, (int64_t)64);
+        } else if (strOption == "compression") {
+            tuning.fCompression = n != 0;
+        } else if (strOption == "maxopenfiles") {
+            tuning.nMaxOpenFiles = std::max(n, (int64_t)16);
+        } else {
+            strError = strprintf("Unknown option '%s' in -dbtune argument '%s'", strOption, strArg);
+            return false;
+        }
+    }
+    return true;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CLevelDBTuning& tuning)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = tuning.nWriteBufferSize ? tuning.nWriteBufferSize : nCacheSize / 4;
+    options.filter_policy = tuning.nBloomBits ? leveldb::NewBloomFilterPolicy(tuning.nBloomBits) : NULL;
+    options.compression = tuning.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = tuning.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -43,14 +84,17 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, const CLevelDBTuning& tuningIn)
+    : strPath(path.string()), tuning(tuningIn), nReads(0), nReadBytes(0), nWrites(0), nWriteBytes(0), nSyncs(0)
 {
+    tuning.nCacheSize = nCacheSize;
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, tuning);
+    tuning.nWriteBufferSize = options.write_buffer_size;
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -84,5 +128,33 @@ bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     HandleError(status);
+    nWrites++;
+    nWriteBytes += batch.nSize;
+    if (fSync)
+        nSyncs++;
     return true;
 }
+
+bool CLevelDBWrapper::GetProperty(const std::string& strProperty, std::string& strValue) const
+{
+    return pdb->GetProperty(strProperty, &strValue);
+}
+
+void CLevelDBWrapper::GetStats(CLevelDBStats& stats) const
+{
+    stats.strPath = strPath;
+    stats.tuning = tuning;
+    stats.nReads = nReads;
+    stats.nReadBytes = nReadBytes;
+    stats.nWrites = nWrites;
+    stats.nWriteBytes = nWriteBytes;
+    stats.nSyncs = nSyncs;
+
+    std::string strValue;
+    if (GetProperty("leveldb.approximate-memory-usage", strValue))
+        stats.nMemoryUsage = atoi64(strValue);
+    stats.vFilesAtLevel.clear();
+    for (int nLevel = 0; GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel), strValue); nLevel++)
+        stats.vFilesAtLevel.push_back(atoi(strValue));
+    GetProperty("leveldb.stats", stats.strCompactionStats);
+}
@@ -11,6 +11,11 @@
 #include "util.h"
 #include "version.h"
 
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
@@ -24,6 +29,49 @@ public:
 
 void HandleError(const leveldb::Status& status);
 
+//! max. -dbtune cache and writebuffer sizes (MiB)
+static const int64_t MAX_LEVELDB_TUNING_SIZE = sizeof(void*) > 4 ? 16384 : 1024;
+
+/** LevelDB options of one database, see ParseLevelDBTuning */
+struct CLevelDBTuning {
+    //! cache size in bytes, 0 for the database's share of -dbcache
+    size_t nCacheSize;
+    //! memtable size in bytes, 0 for a quarter of the cache size
+    size_t nWriteBufferSize;
+    //! bits per key of the bloom filter, 0 for no filter
+    int nBloomBits;
+    //! compress table blocks with snappy
+    bool fCompression;
+    int nMaxOpenFiles;
+
+    CLevelDBTuning() : nCacheSize(0), nWriteBufferSize(0), nBloomBits(10), fCompression(false), nMaxOpenFiles(64) {}
+};
+
+/**
+ * Parse -dbtune=<database>.<option>=<n> arguments into the tuning of each named database.
+ * Options are cache and writebuffer (MiB), bloombits, compression (0/1) and maxopenfiles.
+ */
+bool ParseLevelDBTuning(const std::vector<std::string>& vArgs, std::map<std::string, CLevelDBTuning>& mapTuning, std::string& strError);
+
+/** Usage counters and effective options of an open database */
+struct CLevelDBStats {
+    std::string strPath;
+    CLevelDBTuning tuning;
+    uint64_t nReads;
+    uint64_t nReadBytes;
+    uint64_t nWrites;
+    uint64_t nWriteBytes;
+    uint64_t nSyncs;
+    //! leveldb.approximate-memory-usage: memtables and block cache
+    uint64_t nMemoryUsage;
+    //! number of table files at each level
+    std::vector<int> vFilesAtLevel;
+    //! leveldb.stats: compaction statistics per level
+    std::string strCompactionStats;
+
+    CLevelDBStats() : nReads(0), nReadBytes(0), nWrites(0), nWriteBytes(0), nSyncs(0), nMemoryUsage(0) {}
+};
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -31,8 +79,12 @@ class CLevelDBBatch
 
 private:
     leveldb::WriteBatch batch;
+    //! bytes of the keys and values queued
+    size_t nSize;
 
 public:
+    CLevelDBBatch() : nSize(0) {}
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -47,6 +99,7 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        nSize += slKey.size() + slValue.size();
     }
 
     template <typename K>
@@ -58,6 +111,13 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        nSize += slKey.size();
+    }
+
+    void Clear()
+    {
+        batch.Clear();
+        nSize = 0;
     }
 };
 
@@ -85,8 +145,18 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    std::string strPath;
+    CLevelDBTuning tuning;
+
+    //! point reads and writes, and the bytes of keys and values they moved
+    mutable std::atomic<uint64_t> nReads;
+    mutable std::atomic<uint64_t> nReadBytes;
+    std::atomic<uint64_t> nWrites;
+    std::atomic<uint64_t> nWriteBytes;
+    std::atomic<uint64_t> nSyncs;
+
 public:
-    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CLevelDBTuning& tuningIn = CLevelDBTuning());
     ~CLevelDBWrapper();
 
     template <typename K, typename V>
@@ -99,12 +169,14 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        nReads++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             HandleError(status);
         }
+        nReadBytes += slKey.size() + strValue.size();
         try {
             CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
@@ -132,12 +204,14 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        nReads++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             HandleError(status);
         }
+        nReadBytes += slKey.size() + strValue.size();
         return true;
     }
 
@@ -168,6 +242,11 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    //! Read a LevelDB property such as leveldb.stats, false if it is unknown
+    bool GetProperty(const std::string& strProperty, std::string& strValue) const;
+
+    void GetStats(CLevelDBStats& stats) const;
 };
 
 #endif // BITCOIN_LEVELDBWRAPPER_H
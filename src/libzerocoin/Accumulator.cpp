@@ -45,7 +45,8 @@ Accumulator::Accumulator(const ZerocoinParams* p, const CoinDenomination d, cons
 
 void Accumulator::increment(const CBigNum& bnValue) {
     // Compute new accumulator = "old accumulator"^{element} mod N
-    this->value = this->value.pow_mod(bnValue, this->params->accumulatorModulus);
+    // Both are public, so the variable time exponentiation of the shared modulus context is fine
+    this->value = this->params->accumulatorMontgomery().pow_mod(this->value, bnValue);
 }
 
 void Accumulator::accumulate(const PublicCoin& coin) {
@@ -120,14 +120,22 @@ bool AccumulatorProofOfKnowledge:: Verify(const Accumulator& a, const CBigNum& v
 
 	CBigNum c = CBigNum(hasher.GetHash()); //this hash should be of length k_prime bits
 
-	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * sg.pow_mod(s_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_2_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * ((valueOfCommitmentToCoin * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(s_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(s_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_3_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * (sg * valueOfCommitmentToCoin).pow_mod(s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-
-	CBigNum t_1_prime = (C_r.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_zeta, params->accumulatorModulus) * g_n.pow_mod(s_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_2_prime = (C_e.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_eta, params->accumulatorModulus) * g_n.pow_mod(s_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_3_prime = ((a.getValue()).pow_mod(c, params->accumulatorModulus) * C_u.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	// Every check is a product of powers of public values. The generators of both groups are
+	// raised through their precomputed tables, the other bases through the shared modulus contexts.
+	const IntegerGroupParams& pokGroup = params->accumulatorPoKCommitmentGroup;
+	const CBigNum& pokModulus = pokGroup.modulus;
+	const CBigNum& accModulus = params->accumulatorModulus;
+	const CBigNumMontgomery& pokMont = pokGroup.montgomery();
+	const CBigNumMontgomery& accMont = params->accumulatorMontgomery();
+
+	CBigNum st_1_prime = pokMont.pow_mod(valueOfCommitmentToCoin, c).mul_mod(pokGroup.gPowVartime(s_alpha), pokModulus).mul_mod(pokGroup.hPowVartime(s_phi), pokModulus);
+	CBigNum st_2_prime = pokMont.pow_mod(valueOfCommitmentToCoin * sg.inverse(pokModulus), s_gamma).mul_mod(pokGroup.gPowVartime(c), pokModulus).mul_mod(pokGroup.hPowVartime(s_psi), pokModulus);
+	CBigNum st_3_prime = pokMont.pow_mod(sg * valueOfCommitmentToCoin, s_sigma).mul_mod(pokGroup.gPowVartime(c), pokModulus).mul_mod(pokGroup.hPowVartime(s_xi), pokModulus);
+
+	CBigNum t_1_prime = accMont.pow_mod(C_r, c).mul_mod(params->qrnHPowVartime(s_zeta), accModulus).mul_mod(params->qrnGPowVartime(s_epsilon), accModulus);
+	CBigNum t_2_prime = accMont.pow_mod(C_e, c).mul_mod(params->qrnHPowVartime(s_eta), accModulus).mul_mod(params->qrnGPowVartime(s_alpha), accModulus);
+	CBigNum t_3_prime = accMont.pow_mod(a.getValue(), c).mul_mod(accMont.pow_mod(C_u, s_alpha), accModulus).mul_mod(params->qrnHPowVartime(0 - s_beta), accModulus);
+	CBigNum t_4_prime = accMont.pow_mod(C_r, s_alpha).mul_mod(params->qrnHPowVartime(0 - s_delta), accModulus).mul_mod(params->qrnGPowVartime(0 - s_beta), accModulus);
 
 	bool result_st1 = (st_1 == st_1_prime);
 	bool result_st2 = (st_2 == st_2_prime);
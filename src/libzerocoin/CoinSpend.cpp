@@ -89,18 +89,24 @@ bool CoinSpend::Verify(const Accumulator& a, bool verifyParams) const
     }
 
     // Verify both of the sub-proofs using the given meta-data
-    if (!commitmentPoK.Verify(serialCommitmentToCoinValue, accCommitmentToCoinValue)) {
-        //std::cout << "CoinsSpend::Verify: commitmentPoK failed\n";
-        return false;
-    }
+    try {
+        if (!commitmentPoK.Verify(serialCommitmentToCoinValue, accCommitmentToCoinValue)) {
+            //std::cout << "CoinsSpend::Verify: commitmentPoK failed\n";
+            return false;
+        }
 
-    if (!accumulatorPoK.Verify(a, accCommitmentToCoinValue)) {
-        //std::cout << "CoinsSpend::Verify: accumulatorPoK failed\n";
-        return false;
-    }
+        if (!accumulatorPoK.Verify(a, accCommitmentToCoinValue)) {
+            //std::cout << "CoinsSpend::Verify: accumulatorPoK failed\n";
+            return false;
+        }
 
-    if (!serialNumberSoK.Verify(coinSerialNumber, serialCommitmentToCoinValue, signatureHash(), verifyParams)) {
-        //std::cout << "CoinsSpend::Verify: serialNumberSoK failed. sighash:" << signatureHash().GetHex() << "\n";
+        if (!serialNumberSoK.Verify(coinSerialNumber, serialCommitmentToCoinValue, signatureHash(), verifyParams)) {
+            //std::cout << "CoinsSpend::Verify: serialNumberSoK failed. sighash:" << signatureHash().GetHex() << "\n";
+            return false;
+        }
+    } catch (const bignum_error& e) {
+        // e.g. a negative exponent on a value that has no inverse
+        //std::cout << "CoinsSpend::Verify: " << e.what() << "\n";
         return false;
     }
 
@@ -126,13 +126,13 @@ bool CommitmentProofOfKnowledge::Verify(const CBigNum& A, const CBigNum& B) cons
 	}
 
 	// Compute T1 = g1^S1 * h1^S2 * inverse(A^{challenge}) mod p1
-	CBigNum T1 = A.pow_mod(this->challenge, ap->modulus).inverse(ap->modulus).mul_mod(
-	                (ap->g.pow_mod(S1, ap->modulus).mul_mod(ap->h.pow_mod(S2, ap->modulus), ap->modulus)),
+	CBigNum T1 = ap->montgomery().pow_mod(A, CBigNum(0) - this->challenge).mul_mod(
+	                ap->gPowVartime(S1).mul_mod(ap->hPowVartime(S2), ap->modulus),
 	                ap->modulus);
 
 	// Compute T2 = g2^S1 * h2^S3 * inverse(B^{challenge}) mod p2
-	CBigNum T2 = B.pow_mod(this->challenge, bp->modulus).inverse(bp->modulus).mul_mod(
-	                (bp->g.pow_mod(S1, bp->modulus).mul_mod(bp->h.pow_mod(S3, bp->modulus), bp->modulus)),
+	CBigNum T2 = bp->montgomery().pow_mod(B, CBigNum(0) - this->challenge).mul_mod(
+	                bp->gPowVartime(S1).mul_mod(bp->hPowVartime(S3), bp->modulus),
 	                bp->modulus);
 
 	// Hash T1 and T2 along with all of the public parameters
@@ -16,8 +16,59 @@
 #include "Params.h"
 #include "ParamGeneration.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace libzerocoin {
 
+namespace {
+
+std::mutex cs_precomputed;
+std::map<std::pair<CBigNum, CBigNum>, std::unique_ptr<CBigNumFixedBase> > mapFixedBaseTables;
+std::map<CBigNum, std::unique_ptr<CBigNumMontgomery> > mapMontgomeryContexts;
+
+//! Returns the shared Montgomery context for modulus
+const CBigNumMontgomery& GetMontgomeryContext(const CBigNum& modulus)
+{
+	std::lock_guard<std::mutex> lock(cs_precomputed);
+	std::unique_ptr<CBigNumMontgomery>& mont = mapMontgomeryContexts[modulus];
+	if (!mont)
+		mont.reset(new CBigNumMontgomery(modulus));
+	return *mont;
+}
+
+//! Returns the table for base mod modulus, covering exponents of up to nMaxBits bits
+const CBigNumFixedBase& GetFixedBaseTable(const CBigNum& base, const CBigNum& modulus, unsigned int nMaxBits)
+{
+	std::lock_guard<std::mutex> lock(cs_precomputed);
+	std::unique_ptr<CBigNumFixedBase>& table = mapFixedBaseTables[std::make_pair(base, modulus)];
+	if (!table)
+		table.reset(new CBigNumFixedBase(base, modulus, nMaxBits));
+	return *table;
+}
+
+//! Bit length bound of the responses an honest accumulator proof raises g_n and h_n to
+unsigned int QRNResponseBits(const AccumulatorAndProofParams& params)
+{
+	CBigNum aM_4 = params.accumulatorModulus / CBigNum((long)4);
+	CBigNum aR_t_aM_4 = aM_4 * CBigNum(2).pow(params.k_prime + params.k_dprime);
+	CBigNum maxChallenge = CBigNum(2).pow(256);
+	CBigNum maxResponse = aR_t_aM_4 * params.accumulatorPoKCommitmentGroup.modulus + maxChallenge * aM_4 * params.maxCoinValue;
+	return maxResponse.bitSize();
+}
+
+//! base^e mod accumulatorModulus for a generator of the hidden order QRN group, e may be negative
+CBigNum QRNPowVartime(const CBigNum& base, const CBigNum& e, const AccumulatorAndProofParams& params)
+{
+	const CBigNumFixedBase& table = GetFixedBaseTable(base, params.accumulatorModulus, QRNResponseBits(params));
+	if (e < CBigNum(0))
+		return table.pow_mod(CBigNum(0) - e).inverse(params.accumulatorModulus);
+	return table.pow_mod(e);
+}
+
+}
+
 ZerocoinParams::ZerocoinParams(CBigNum N, uint32_t securityLevel) {
 	this->zkp_hash_len = securityLevel;
 	this->zkp_iterations = securityLevel;
@@ -36,6 +87,18 @@ AccumulatorAndProofParams::AccumulatorAndProofParams() {
 	this->initialized = false;
 }
 
+const CBigNumMontgomery& AccumulatorAndProofParams::accumulatorMontgomery() const {
+	return GetMontgomeryContext(this->accumulatorModulus);
+}
+
+CBigNum AccumulatorAndProofParams::qrnGPowVartime(const CBigNum& e) const {
+	return QRNPowVartime(this->accumulatorQRNCommitmentGroup.g, e, *this);
+}
+
+CBigNum AccumulatorAndProofParams::qrnHPowVartime(const CBigNum& e) const {
+	return QRNPowVartime(this->accumulatorQRNCommitmentGroup.h, e, *this);
+}
+
 IntegerGroupParams::IntegerGroupParams() {
 	this->initialized = false;
 }
@@ -47,4 +110,16 @@ CBigNum IntegerGroupParams::randomElement() const {
 	return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
 }
 
+const CBigNumMontgomery& IntegerGroupParams::montgomery() const {
+	return GetMontgomeryContext(this->modulus);
+}
+
+CBigNum IntegerGroupParams::gPowVartime(const CBigNum& e) const {
+	return GetFixedBaseTable(this->g, this->modulus, this->groupOrder.bitSize()).pow_mod(e % this->groupOrder);
+}
+
+CBigNum IntegerGroupParams::hPowVartime(const CBigNum& e) const {
+	return GetFixedBaseTable(this->h, this->modulus, this->groupOrder.bitSize()).pow_mod(e % this->groupOrder);
+}
+
 } /* namespace libzerocoin */
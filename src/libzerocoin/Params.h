@@ -34,6 +34,25 @@ public:
 	 * @return a random element in the group.
 	 */
 	CBigNum randomElement() const;
+
+	/**
+	 * Computes g^e (resp. h^e) mod modulus through a table of precomputed
+	 * powers that is built on first use and shared by all copies of the group.
+	 * The exponent is reduced modulo the group order, so this is only valid
+	 * for the prime order groups (not the accumulator QRN pair of generators).
+	 * These run in variable time: only use them for public exponents.
+	 * @param e the exponent
+	 * @return g^e (resp. h^e) mod modulus
+	 */
+	CBigNum gPowVartime(const CBigNum& e) const;
+	CBigNum hPowVartime(const CBigNum& e) const;
+
+	/**
+	 * The Montgomery context for the modulus, built on first use and shared
+	 * by all copies of the group.
+	 */
+	const CBigNumMontgomery& montgomery() const;
+
 	bool initialized;
 
 	/**
@@ -90,6 +109,24 @@ public:
 
 	//AccumulatorAndProofParams(CBigNum accumulatorModulus);
 
+	/**
+	 * Computes g_n^e (resp. h_n^e) mod accumulatorModulus for the generators
+	 * of the hidden order QRN group, through a table of precomputed powers
+	 * sized for the responses of an accumulator proof. The exponent is not
+	 * reduced and may be negative.
+	 * These run in variable time: only use them for public exponents.
+	 * @param e the exponent
+	 * @return g_n^e (resp. h_n^e) mod accumulatorModulus
+	 */
+	CBigNum qrnGPowVartime(const CBigNum& e) const;
+	CBigNum qrnHPowVartime(const CBigNum& e) const;
+
+	/**
+	 * The Montgomery context for accumulatorModulus, built on first use and
+	 * shared by all copies of the parameters.
+	 */
+	const CBigNumMontgomery& accumulatorMontgomery() const;
+
 	bool initialized;
 
 	/**
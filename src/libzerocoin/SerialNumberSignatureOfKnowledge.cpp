@@ -124,12 +124,24 @@ inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculation(const CBig
     return (g.pow_mod(exponent, params->serialNumberSoKCommitmentGroup.modulus) * h.pow_mod(h_exp, params->serialNumberSoKCommitmentGroup.modulus)) % params->serialNumberSoKCommitmentGroup.modulus;
 }
 
+inline CBigNum SerialNumberSignatureOfKnowledge::challengeCalculationVartime(const CBigNum& a_exp, const CBigNum& b_exp,
+        const CBigNum& h_exp) const {
+
+    // Same as challengeCalculation, but through the fixed-base tables of the generators.
+    // The coin commitment group modulus is the SoK group order, see Verify.
+    const IntegerGroupParams& coinGroup = params->coinCommitmentGroup;
+    const IntegerGroupParams& sokGroup = params->serialNumberSoKCommitmentGroup;
+
+    CBigNum exponent = coinGroup.gPowVartime(a_exp).mul_mod(coinGroup.hPowVartime(b_exp), sokGroup.groupOrder);
+
+    return sokGroup.gPowVartime(exponent).mul_mod(sokGroup.hPowVartime(h_exp), sokGroup.modulus);
+}
+
 bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, const CBigNum& valueOfCommitmentToCoin,
         const uint256 msghash, bool isInParamsValidationRange) const {
-    CBigNum a = params->coinCommitmentGroup.g;
-    CBigNum b = params->coinCommitmentGroup.h;
-    CBigNum g = params->serialNumberSoKCommitmentGroup.g;
-    CBigNum h = params->serialNumberSoKCommitmentGroup.h;
+    // All values checked here are public, so the variable time exponentiations can be used
+    if (params->coinCommitmentGroup.modulus != params->serialNumberSoKCommitmentGroup.groupOrder)
+        return error("Groups are not structured correctly.");
 
     //// Params validation.
     if(isInParamsValidationRange) {
@@ -158,14 +170,12 @@ bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, c
                 CBigNum bn = SeedTo1024(sprime[i].getuint256());
                 if (bn > params->serialNumberSoKCommitmentGroup.groupOrder && isInParamsValidationRange)
                     return error("SoK Verify() :: sprime in pos %d not in valid range", i);
-                tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], bn);
+                tprime[i] = challengeCalculationVartime(coinSerialNumber, s_notprime[i], bn);
             } else {
-                CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-                tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) %
-                              params->serialNumberSoKCommitmentGroup.modulus) *
-                             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) %
-                              params->serialNumberSoKCommitmentGroup.modulus)) %
-                            params->serialNumberSoKCommitmentGroup.modulus;
+                CBigNum exp = params->coinCommitmentGroup.hPowVartime(s_notprime[i]);
+                tprime[i] = params->serialNumberSoKCommitmentGroup.montgomery().pow_mod(valueOfCommitmentToCoin, exp).mul_mod(
+                            params->serialNumberSoKCommitmentGroup.hPowVartime(sprime[i]),
+                            params->serialNumberSoKCommitmentGroup.modulus);
             }
         }
         for (uint32_t i = 0; i < params->zkp_iterations; i++) {
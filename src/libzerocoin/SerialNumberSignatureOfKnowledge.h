@@ -71,6 +71,8 @@ private:
     std::vector<CBigNum> sprime;
     inline CBigNum challengeCalculation(const CBigNum& a_exp, const CBigNum& b_exp,
                                        const CBigNum& h_exp) const;
+    inline CBigNum challengeCalculationVartime(const CBigNum& a_exp, const CBigNum& b_exp,
+                                               const CBigNum& h_exp) const;
 };
 
 } /* namespace libzerocoin */
@@ -36,6 +36,8 @@ public:
     explicit bignum_error(const std::string& str) : std::runtime_error(str) {}
 };
 
+class CBigNumMontgomery;
+
 /** C++ wrapper for BIGNUM */
 class CBigNum
 {
@@ -147,6 +149,16 @@ public:
      */
     CBigNum pow_mod(const CBigNum& e, const CBigNum& m) const;
 
+    /**
+     * simultaneous modular exponentiation: (b[0]^e[0] * b[1]^e[1] * ...) mod m
+     * Runs in variable time, so it must only be used with public exponents.
+     * @param vBases the bases
+     * @param vExps the exponents, negative ones use the inverse of their base
+     * @param m modulus, which must be odd (or a prepared context for it)
+     */
+    static CBigNum multi_pow_mod(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNum& m);
+    static CBigNum multi_pow_mod(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNumMontgomery& mont);
+
     /**
     * Calculates the inverse of this element mod m.
     * i.e. i such this*i = 1 mod m
@@ -210,6 +222,113 @@ public:
     friend inline bool operator>=(const CBigNum& a, const CBigNum& b);
     friend inline bool operator<(const CBigNum& a, const CBigNum& b);
     friend inline bool operator>(const CBigNum& a, const CBigNum& b);
+    friend class CBigNumMontgomery;
+    friend class CBigNumFixedBase;
+};
+
+/**
+ * Reusable context for arithmetic modulo a fixed odd modulus.
+ * R^2 mod modulus and -modulus^-1 mod 2^w are computed once, after which values
+ * kept in Montgomery form (a * R mod modulus) are multiplied without any division
+ * or per call setup. Hold on to one for moduli that are used over and over.
+ */
+class CBigNumMontgomery
+{
+public:
+    /**
+     * Prepares the context
+     * @param modulusIn the modulus, which must be odd
+     */
+    explicit CBigNumMontgomery(const CBigNum& modulusIn);
+    ~CBigNumMontgomery();
+
+    const CBigNum& getModulus() const { return modulus; }
+
+    /**
+     * converts into Montgomery form: (a * R) mod modulus
+     * @param a any value, reduced first
+     */
+    CBigNum toMont(const CBigNum& a) const;
+
+    /**
+     * converts out of Montgomery form: (a * R^-1) mod modulus
+     * @param a a value in Montgomery form
+     */
+    CBigNum fromMont(const CBigNum& a) const;
+
+    /**
+     * Montgomery product: r = (a * b * R^-1) mod modulus
+     * @param r the result, may alias a or b
+     * @param a a value in Montgomery form
+     * @param b a value in Montgomery form
+     */
+    void mul(CBigNum& r, const CBigNum& a, const CBigNum& b) const;
+
+    /**
+     * modular multiplication of plain values: (a * b) mod modulus
+     */
+    CBigNum mul_mod(const CBigNum& a, const CBigNum& b) const;
+
+    /**
+     * modular exponentiation of plain values: base^e mod modulus
+     * Runs in variable time, so it must only be used with public exponents.
+     * @param base the base
+     * @param e exponent, a negative one uses the inverse of base
+     */
+    CBigNum pow_mod(const CBigNum& base, const CBigNum& e) const;
+
+private:
+    CBigNum modulus;
+#if defined(USE_NUM_OPENSSL)
+    BN_MONT_CTX* mont;
+#endif
+#if defined(USE_NUM_GMP)
+    //! R^2 mod modulus, with R = 2^(GMP_NUMB_BITS * nLimbs)
+    CBigNum rr;
+    //! -modulus^-1 mod 2^GMP_NUMB_BITS
+    mp_limb_t n0;
+    mp_size_t nLimbs;
+#endif
+
+    CBigNumMontgomery(const CBigNumMontgomery&);
+    CBigNumMontgomery& operator=(const CBigNumMontgomery&);
+
+    friend class CBigNum;
+    friend class CBigNumFixedBase;
+};
+
+/**
+ * Precomputed powers of a fixed base modulo a fixed modulus, for fast
+ * exponentiation of long lived group generators.
+ * Runs in variable time, so it must only be used with public exponents.
+ */
+class CBigNumFixedBase
+{
+public:
+    //! Number of exponent bits consumed per table lookup
+    static const unsigned int WINDOW_BITS = 4;
+
+    /**
+     * Builds the table of powers
+     * @param baseIn the fixed base
+     * @param modulusIn the fixed modulus, which must be odd
+     * @param nMaxBitsIn the longest exponent the table covers
+     */
+    CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, unsigned int nMaxBitsIn);
+
+    /**
+     * modular exponentiation: base^e mod modulus
+     * Negative exponents and exponents longer than the table fall back to CBigNum::pow_mod.
+     * @param e exponent
+     */
+    CBigNum pow_mod(const CBigNum& e) const;
+
+private:
+    CBigNum base;
+    CBigNumMontgomery mont;
+    unsigned int nMaxBits;
+    //! table[i * 2^WINDOW_BITS + d] = base^(d * 2^(i * WINDOW_BITS)) mod modulus, in Montgomery form
+    std::vector<CBigNum> table;
 };
 
 #if defined(USE_NUM_OPENSSL)
@@ -8,6 +8,8 @@
 
 #include "bignum.h"
 
+#include <algorithm>
+
 /** C++ wrapper for BIGNUM (Gmp bignum) */
 CBigNum::CBigNum()
 {
@@ -247,6 +249,76 @@ CBigNum CBigNum::pow_mod(const CBigNum& e, const CBigNum& m) const
     return ret;
 }
 
+/**
+ * simultaneous modular exponentiation: (b[0]^e[0] * b[1]^e[1] * ...) mod m
+ * @param vBases the bases
+ * @param vExps the exponents, negative ones use the inverse of their base
+ * @param m modulus
+ */
+CBigNum CBigNum::multi_pow_mod(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNum& m)
+{
+    if (vBases.size() != vExps.size())
+        throw bignum_error("CBigNum::multi_pow_mod : number of bases and exponents differ");
+
+    // A lone base is best left to Gmp's own (variable time) exponentiation
+    if (vBases.size() == 1) {
+        CBigNum ret;
+        mpz_mod(ret.bn, vBases[0].bn, m.bn);
+        if (mpz_sgn(vExps[0].bn) < 0 && !mpz_invert(ret.bn, ret.bn, m.bn))
+            throw bignum_error("CBigNum::multi_pow_mod : base has no inverse for negative exponent");
+        CBigNum e;
+        mpz_abs(e.bn, vExps[0].bn);
+        mpz_powm(ret.bn, ret.bn, e.bn, m.bn);
+        return ret;
+    }
+
+    return multi_pow_mod(vBases, vExps, CBigNumMontgomery(m));
+}
+
+CBigNum CBigNum::multi_pow_mod(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNumMontgomery& mont)
+{
+    if (vBases.size() != vExps.size())
+        throw bignum_error("CBigNum::multi_pow_mod : number of bases and exponents differ");
+    if (vBases.size() == 1)
+        return mont.pow_mod(vBases[0], vExps[0]);
+
+    // Straus' method: every base gets a small table of powers, then all exponents are
+    // scanned together a window at a time so the squarings are shared between them.
+    // Everything stays in Montgomery form until the end.
+    const CBigNum& m = mont.getModulus();
+    const unsigned int nWindow = CBigNumFixedBase::WINDOW_BITS;
+    const unsigned int nEntries = 1 << nWindow;
+    std::vector<CBigNum> vTable(vBases.size() * nEntries);
+    std::vector<CBigNum> vAbsExps(vExps.size());
+    size_t nBits = 0;
+    for (unsigned int i = 0; i < vBases.size(); i++) {
+        CBigNum* row = &vTable[i * nEntries];
+        mpz_mod(row[1].bn, vBases[i].bn, m.bn);
+        if (mpz_sgn(vExps[i].bn) < 0 && !mpz_invert(row[1].bn, row[1].bn, m.bn))
+            throw bignum_error("CBigNum::multi_pow_mod : base has no inverse for negative exponent");
+        row[1] = mont.toMont(row[1]);
+        for (unsigned int d = 2; d < nEntries; d++)
+            mont.mul(row[d], row[d - 1], row[1]);
+        mpz_abs(vAbsExps[i].bn, vExps[i].bn);
+        nBits = std::max(nBits, mpz_sizeinbase(vAbsExps[i].bn, 2));
+    }
+
+    CBigNum ret = mont.toMont(1);
+    for (size_t nPos = (nBits + nWindow - 1) / nWindow * nWindow; nPos > 0; ) {
+        nPos -= nWindow;
+        for (unsigned int k = 0; k < nWindow; k++)
+            mont.mul(ret, ret, ret);
+        for (unsigned int i = 0; i < vAbsExps.size(); i++) {
+            unsigned int nDigit = 0;
+            for (unsigned int k = 0; k < nWindow; k++)
+                nDigit |= mpz_tstbit(vAbsExps[i].bn, nPos + k) << k;
+            if (nDigit)
+                mont.mul(ret, ret, vTable[i * nEntries + nDigit]);
+        }
+    }
+    return mont.fromMont(ret);
+}
+
 /**
 * Calculates the inverse of this element mod m.
 * i.e. i such this*i = 1 mod m
@@ -351,3 +423,155 @@ CBigNum& CBigNum::operator--()
     mpz_sub(bn, bn, CBigNum(1).bn);
     return *this;
 }
+
+/** Montgomery contexts (Gmp bignum) */
+namespace {
+
+//! Moduli of up to this many limbs are multiplied in stack buffers
+const mp_size_t MONT_STACK_LIMBS = 64;
+
+//! Copies a non-negative value of at most n limbs into rp, zero padded to n limbs
+void CopyLimbs(mp_limb_t* rp, const mpz_t a, mp_size_t n)
+{
+    mp_size_t nSize = mpz_size(a);
+    const mp_limb_t* ap = mpz_limbs_read(a);
+    for (mp_size_t i = 0; i < nSize; i++)
+        rp[i] = ap[i];
+    for (mp_size_t i = nSize; i < n; i++)
+        rp[i] = 0;
+}
+
+}
+
+CBigNumMontgomery::CBigNumMontgomery(const CBigNum& modulusIn) : modulus(modulusIn)
+{
+    if (mpz_sgn(modulus.bn) <= 0 || mpz_even_p(modulus.bn))
+        throw bignum_error("CBigNumMontgomery : modulus must be odd and positive");
+    nLimbs = mpz_size(modulus.bn);
+
+    CBigNum limbBase;
+    mpz_setbit(limbBase.bn, GMP_NUMB_BITS);
+    CBigNum inv;
+    mpz_invert(inv.bn, modulus.bn, limbBase.bn);
+    mpz_sub(inv.bn, limbBase.bn, inv.bn);
+    n0 = mpz_getlimbn(inv.bn, 0);
+
+    mpz_setbit(rr.bn, 2 * GMP_NUMB_BITS * nLimbs);
+    mpz_mod(rr.bn, rr.bn, modulus.bn);
+}
+
+CBigNumMontgomery::~CBigNumMontgomery() {}
+
+void CBigNumMontgomery::mul(CBigNum& r, const CBigNum& a, const CBigNum& b) const
+{
+    const mp_size_t n = nLimbs;
+    mp_limb_t stackBuf[4 * MONT_STACK_LIMBS];
+    std::vector<mp_limb_t> heapBuf;
+    mp_limb_t* ap = stackBuf;
+    if (n > MONT_STACK_LIMBS) {
+        heapBuf.resize(4 * n);
+        ap = heapBuf.data();
+    }
+    mp_limb_t* bp = ap + n;
+    mp_limb_t* tp = bp + n;
+
+    // t = a * b
+    CopyLimbs(ap, a.bn, n);
+    if (&a == &b) {
+        mpn_sqr(tp, ap, n);
+    } else {
+        CopyLimbs(bp, b.bn, n);
+        mpn_mul_n(tp, ap, bp, n);
+    }
+
+    // Word by word reduction: clear the low limb of t with a multiple of the
+    // modulus, n times, leaving t / R in the high half (plus a carry out)
+    const mp_limb_t* mp = mpz_limbs_read(modulus.bn);
+    mp_limb_t nCarry = 0;
+    for (mp_size_t i = 0; i < n; i++) {
+        mp_limb_t c = mpn_addmul_1(tp + i, mp, n, tp[i] * n0);
+        nCarry += mpn_add_1(tp + i + n, tp + i + n, n - i, c);
+    }
+
+    mp_limb_t* rp = mpz_limbs_write(r.bn, n);
+    if (nCarry || mpn_cmp(tp + n, mp, n) >= 0)
+        mpn_sub_n(rp, tp + n, mp, n);
+    else
+        mpn_copyi(rp, tp + n, n);
+    mpz_limbs_finish(r.bn, n);
+}
+
+CBigNum CBigNumMontgomery::toMont(const CBigNum& a) const
+{
+    CBigNum ret;
+    mpz_mod(ret.bn, a.bn, modulus.bn);
+    mul(ret, ret, rr);
+    return ret;
+}
+
+CBigNum CBigNumMontgomery::fromMont(const CBigNum& a) const
+{
+    CBigNum ret;
+    mul(ret, a, CBigNum(1));
+    return ret;
+}
+
+CBigNum CBigNumMontgomery::mul_mod(const CBigNum& a, const CBigNum& b) const
+{
+    // a * (b * R) * R^-1
+    CBigNum ret, bMont = toMont(b);
+    mpz_mod(ret.bn, a.bn, modulus.bn);
+    mul(ret, ret, bMont);
+    return ret;
+}
+
+CBigNum CBigNumMontgomery::pow_mod(const CBigNum& base, const CBigNum& e) const
+{
+    // Gmp's own variable time exponentiation already works in Montgomery form
+    CBigNum ret;
+    mpz_mod(ret.bn, base.bn, modulus.bn);
+    if (mpz_sgn(e.bn) < 0 && !mpz_invert(ret.bn, ret.bn, modulus.bn))
+        throw bignum_error("CBigNumMontgomery::pow_mod : base has no inverse for negative exponent");
+    CBigNum absExp;
+    mpz_abs(absExp.bn, e.bn);
+    mpz_powm(ret.bn, ret.bn, absExp.bn, modulus.bn);
+    return ret;
+}
+
+/** Fixed-base exponentiation tables (Gmp bignum) */
+CBigNumFixedBase::CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, unsigned int nMaxBitsIn) : base(baseIn), mont(modulusIn), nMaxBits(nMaxBitsIn)
+{
+    const unsigned int nEntries = 1 << WINDOW_BITS;
+    const unsigned int nRows = (nMaxBits + WINDOW_BITS - 1) / WINDOW_BITS;
+    table.resize(nRows * nEntries);
+
+    // base^(2^(i * WINDOW_BITS)) for the current row
+    CBigNum rowBase = mont.toMont(base);
+    const CBigNum one = mont.toMont(1);
+    for (unsigned int i = 0; i < nRows; i++) {
+        CBigNum* row = &table[i * nEntries];
+        row[0] = one;
+        row[1] = rowBase;
+        for (unsigned int d = 2; d < nEntries; d++)
+            mont.mul(row[d], row[d - 1], rowBase);
+        mont.mul(rowBase, row[nEntries - 1], rowBase);
+    }
+}
+
+CBigNum CBigNumFixedBase::pow_mod(const CBigNum& e) const
+{
+    if (mpz_sgn(e.bn) < 0 || mpz_sizeinbase(e.bn, 2) > nMaxBits)
+        return base.pow_mod(e, mont.getModulus());
+
+    const unsigned int nEntries = 1 << WINDOW_BITS;
+    const size_t nRows = (mpz_sizeinbase(e.bn, 2) + WINDOW_BITS - 1) / WINDOW_BITS;
+    CBigNum ret = table[0];
+    for (size_t i = 0; i < nRows; i++) {
+        unsigned int nDigit = 0;
+        for (unsigned int k = 0; k < WINDOW_BITS; k++)
+            nDigit |= mpz_tstbit(e.bn, i * WINDOW_BITS + k) << k;
+        if (nDigit)
+            mont.mul(ret, ret, table[i * nEntries + nDigit]);
+    }
+    return mont.fromMont(ret);
+}
@@ -8,6 +8,8 @@
 
 #include "bignum.h"
 
+#include <algorithm>
+
 CBigNum::CBigNum()
 {
     bn = BN_new();
@@ -375,6 +377,79 @@ CBigNum CBigNum::pow_mod(const CBigNum& e, const CBigNum& m) const
     return ret;
 }
 
+/**
+ * simultaneous modular exponentiation: (b[0]^e[0] * b[1]^e[1] * ...) mod m
+ * @param vBases the bases
+ * @param vExps the exponents, negative ones use the inverse of their base
+ * @param m modulus
+ */
+CBigNum CBigNum::multi_pow_mod(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNum& m)
+{
+    if (vBases.size() != vExps.size())
+        throw bignum_error("CBigNum::multi_pow_mod : number of bases and exponents differ");
+
+    // A lone base is best left to OpenSSL's own exponentiation
+    if (vBases.size() == 1)
+        return vBases[0].pow_mod(vExps[0], m);
+
+    return multi_pow_mod(vBases, vExps, CBigNumMontgomery(m));
+}
+
+CBigNum CBigNum::multi_pow_mod(const std::vector<CBigNum>& vBases, const std::vector<CBigNum>& vExps, const CBigNumMontgomery& mont)
+{
+    if (vBases.size() != vExps.size())
+        throw bignum_error("CBigNum::multi_pow_mod : number of bases and exponents differ");
+    if (vBases.size() == 1)
+        return mont.pow_mod(vBases[0], vExps[0]);
+
+    // Straus' method: every base gets a small table of powers, then all exponents are
+    // scanned together a window at a time so the squarings are shared between them.
+    // Everything stays in Montgomery form until the end.
+    CAutoBN_CTX pctx;
+    const CBigNum& m = mont.getModulus();
+    const unsigned int nWindow = CBigNumFixedBase::WINDOW_BITS;
+    const unsigned int nEntries = 1 << nWindow;
+    std::vector<CBigNum> vTable(vBases.size() * nEntries);
+    std::vector<CBigNum> vAbsExps(vExps.size());
+    int nBits = 0;
+    for (unsigned int i = 0; i < vBases.size(); i++) {
+        CBigNum* row = &vTable[i * nEntries];
+        if (!BN_nnmod(row[1].bn, vBases[i].bn, m.bn, pctx))
+            throw bignum_error("CBigNum::multi_pow_mod : BN_nnmod failed");
+        if (BN_is_negative(vExps[i].bn) && !BN_mod_inverse(row[1].bn, row[1].bn, m.bn, pctx))
+            throw bignum_error("CBigNum::multi_pow_mod : base has no inverse for negative exponent");
+        if (!BN_to_montgomery(row[1].bn, row[1].bn, mont.mont, pctx))
+            throw bignum_error("CBigNum::multi_pow_mod : BN_to_montgomery failed");
+        for (unsigned int d = 2; d < nEntries; d++) {
+            if (!BN_mod_mul_montgomery(row[d].bn, row[d - 1].bn, row[1].bn, mont.mont, pctx))
+                throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+        }
+        if (!BN_copy(vAbsExps[i].bn, vExps[i].bn))
+            throw bignum_error("CBigNum::multi_pow_mod : BN_copy failed");
+        BN_set_negative(vAbsExps[i].bn, 0);
+        nBits = std::max(nBits, BN_num_bits(vAbsExps[i].bn));
+    }
+
+    CBigNum ret = mont.toMont(1);
+    for (int nPos = (nBits + nWindow - 1) / nWindow * nWindow; nPos > 0; ) {
+        nPos -= nWindow;
+        for (unsigned int k = 0; k < nWindow; k++) {
+            if (!BN_mod_mul_montgomery(ret.bn, ret.bn, ret.bn, mont.mont, pctx))
+                throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+        }
+        for (unsigned int i = 0; i < vAbsExps.size(); i++) {
+            unsigned int nDigit = 0;
+            for (unsigned int k = 0; k < nWindow; k++)
+                nDigit |= BN_is_bit_set(vAbsExps[i].bn, nPos + k) << k;
+            if (nDigit && !BN_mod_mul_montgomery(ret.bn, ret.bn, vTable[i * nEntries + nDigit].bn, mont.mont, pctx))
+                throw bignum_error("CBigNum::multi_pow_mod : BN_mod_mul_montgomery failed");
+        }
+    }
+    if (!BN_from_montgomery(ret.bn, ret.bn, mont.mont, pctx))
+        throw bignum_error("CBigNum::multi_pow_mod : BN_from_montgomery failed");
+    return ret;
+}
+
 /**
 * Calculates the inverse of this element mod m.
 * i.e. i such this*i = 1 mod m
@@ -508,3 +583,115 @@ CBigNum& CBigNum::operator--()
     bn = r.bn;
     return *this;
 }
+
+/** Montgomery contexts (OpenSSL bignum) */
+CBigNumMontgomery::CBigNumMontgomery(const CBigNum& modulusIn) : modulus(modulusIn)
+{
+    if (!BN_is_odd(modulus.bn) || BN_is_negative(modulus.bn))
+        throw bignum_error("CBigNumMontgomery : modulus must be odd and positive");
+    CAutoBN_CTX pctx;
+    mont = BN_MONT_CTX_new();
+    if (mont == NULL || !BN_MONT_CTX_set(mont, modulus.bn, pctx)) {
+        BN_MONT_CTX_free(mont);
+        throw bignum_error("CBigNumMontgomery : BN_MONT_CTX_set failed");
+    }
+}
+
+CBigNumMontgomery::~CBigNumMontgomery()
+{
+    BN_MONT_CTX_free(mont);
+}
+
+void CBigNumMontgomery::mul(CBigNum& r, const CBigNum& a, const CBigNum& b) const
+{
+    CAutoBN_CTX pctx;
+    if (!BN_mod_mul_montgomery(r.bn, a.bn, b.bn, mont, pctx))
+        throw bignum_error("CBigNumMontgomery::mul : BN_mod_mul_montgomery failed");
+}
+
+CBigNum CBigNumMontgomery::toMont(const CBigNum& a) const
+{
+    CAutoBN_CTX pctx;
+    CBigNum ret;
+    if (!BN_nnmod(ret.bn, a.bn, modulus.bn, pctx) || !BN_to_montgomery(ret.bn, ret.bn, mont, pctx))
+        throw bignum_error("CBigNumMontgomery::toMont : BN_to_montgomery failed");
+    return ret;
+}
+
+CBigNum CBigNumMontgomery::fromMont(const CBigNum& a) const
+{
+    CAutoBN_CTX pctx;
+    CBigNum ret;
+    if (!BN_from_montgomery(ret.bn, a.bn, mont, pctx))
+        throw bignum_error("CBigNumMontgomery::fromMont : BN_from_montgomery failed");
+    return ret;
+}
+
+CBigNum CBigNumMontgomery::mul_mod(const CBigNum& a, const CBigNum& b) const
+{
+    // a * (b * R) * R^-1
+    CAutoBN_CTX pctx;
+    CBigNum ret, bMont = toMont(b);
+    if (!BN_nnmod(ret.bn, a.bn, modulus.bn, pctx) || !BN_mod_mul_montgomery(ret.bn, ret.bn, bMont.bn, mont, pctx))
+        throw bignum_error("CBigNumMontgomery::mul_mod : BN_mod_mul_montgomery failed");
+    return ret;
+}
+
+CBigNum CBigNumMontgomery::pow_mod(const CBigNum& base, const CBigNum& e) const
+{
+    CAutoBN_CTX pctx;
+    CBigNum ret, absExp;
+    if (!BN_nnmod(ret.bn, base.bn, modulus.bn, pctx))
+        throw bignum_error("CBigNumMontgomery::pow_mod : BN_nnmod failed");
+    if (BN_is_negative(e.bn) && !BN_mod_inverse(ret.bn, ret.bn, modulus.bn, pctx))
+        throw bignum_error("CBigNumMontgomery::pow_mod : base has no inverse for negative exponent");
+    if (!BN_copy(absExp.bn, e.bn))
+        throw bignum_error("CBigNumMontgomery::pow_mod : BN_copy failed");
+    BN_set_negative(absExp.bn, 0);
+    if (!BN_mod_exp_mont(ret.bn, ret.bn, absExp.bn, modulus.bn, pctx, mont))
+        throw bignum_error("CBigNumMontgomery::pow_mod : BN_mod_exp_mont failed");
+    return ret;
+}
+
+/** Fixed-base exponentiation tables (OpenSSL bignum) */
+CBigNumFixedBase::CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, unsigned int nMaxBitsIn) : base(baseIn), mont(modulusIn), nMaxBits(nMaxBitsIn)
+{
+    CAutoBN_CTX pctx;
+    const unsigned int nEntries = 1 << WINDOW_BITS;
+    const unsigned int nRows = (nMaxBits + WINDOW_BITS - 1) / WINDOW_BITS;
+    table.resize(nRows * nEntries);
+
+    // base^(2^(i * WINDOW_BITS)) for the current row
+    CBigNum rowBase = mont.toMont(base);
+    const CBigNum one = mont.toMont(1);
+    for (unsigned int i = 0; i < nRows; i++) {
+        CBigNum* row = &table[i * nEntries];
+        row[0] = one;
+        row[1] = rowBase;
+        for (unsigned int d = 2; d < nEntries; d++) {
+            if (!BN_mod_mul_montgomery(row[d].bn, row[d - 1].bn, rowBase.bn, mont.mont, pctx))
+                throw bignum_error("CBigNumFixedBase : BN_mod_mul_montgomery failed");
+        }
+        if (!BN_mod_mul_montgomery(rowBase.bn, row[nEntries - 1].bn, rowBase.bn, mont.mont, pctx))
+            throw bignum_error("CBigNumFixedBase : BN_mod_mul_montgomery failed");
+    }
+}
+
+CBigNum CBigNumFixedBase::pow_mod(const CBigNum& e) const
+{
+    if (BN_is_negative(e.bn) || (unsigned int)BN_num_bits(e.bn) > nMaxBits)
+        return base.pow_mod(e, mont.getModulus());
+
+    CAutoBN_CTX pctx;
+    const unsigned int nEntries = 1 << WINDOW_BITS;
+    const int nRows = (BN_num_bits(e.bn) + WINDOW_BITS - 1) / WINDOW_BITS;
+    CBigNum ret = table[0];
+    for (int i = 0; i < nRows; i++) {
+        unsigned int nDigit = 0;
+        for (unsigned int k = 0; k < WINDOW_BITS; k++)
+            nDigit |= BN_is_bit_set(e.bn, i * WINDOW_BITS + k) << k;
+        if (nDigit && !BN_mod_mul_montgomery(ret.bn, ret.bn, table[i * nEntries + nDigit].bn, mont.mont, pctx))
+            throw bignum_error("CBigNumFixedBase::pow_mod : BN_mod_mul_montgomery failed");
+    }
+    return mont.fromMont(ret);
+}
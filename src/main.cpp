@@ -13,6 +13,10 @@
 #include "zNZR/accumulatormap.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockcache.h"
+#include "blockencodings.h"
+#include "blockfilemap.h"
+#include "blockfilewriter.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -23,6 +27,7 @@
 #include "masternode-payments.h"
 #include "masternodeman.h"
 #include "merkleblock.h"
+#include "messageworkers.h"
 #include "net.h"
 #include "obfuscation.h"
 #include "pow.h"
@@ -75,8 +80,12 @@ bool fReindex = false;
 bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fBlockMmap = DEFAULT_BLOCK_MMAP;
+bool fHavePruned = false;
+bool fPruneMode = false;
+uint64_t nPruneTarget = 0;
 bool fVerifyingBlocks = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 bool fClearSpendCache = false;
 
@@ -154,6 +163,30 @@ CCriticalSection cs_LastBlockFile;
 std::vector<CBlockFileInfo> vinfoBlockFile;
 int nLastBlockFile = 0;
 
+/** Memory mappings of block files that are no longer appended to. */
+CBlockFileMapCache blockFileMaps(MAX_BLOCK_FILE_MAPPINGS);
+
+/**
+ * Whether block and undo files should be checked for pruning. Set on startup and
+ * whenever more file space is allocated in prune mode.
+ */
+bool fCheckForPruning = false;
+
+/** Outcome of the last pruning check of a block file that was not pruned. */
+struct CBlockFilePruneCheck {
+    int nHeight;     //! tip height at the time of the check
+    bool fPrunable;  //! whether it held nothing that must be retained
+    //! transactions of the file that had unspent outputs, the only ones the next check looks up
+    std::vector<uint256> vUnspentTxids;
+};
+std::map<int, CBlockFilePruneCheck> mapBlockFilePruneChecks;
+
+/** Block files holding data that is needed for good and that are never pruned. */
+std::set<int> setBlockFilesRetained;
+
+/** Height of chainActive's tip, for deciding without cs_main which blocks read from disk to cache. */
+std::atomic<int> nBlockCacheTipHeight(-1);
+
 /**
      * Every received block is assigned a unique and increasing identifier, so we
      * know which one to give priority in case of a fork.
@@ -178,6 +211,16 @@ struct QueuedBlock {
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+/**
+ * Blocks downloaded before the data of their parent, with the peer they came from.
+ * A proof-of-stake block can only be checked once its parent is accepted, so they
+ * wait here for it. Protected by cs_main.
+ */
+std::map<uint256, std::pair<NodeId, CBlock> > mapBlocksWaitingForParent;
+std::multimap<uint256, uint256> mapBlocksWaitingByParent;
+/** Serialized size of the blocks in mapBlocksWaitingForParent. */
+size_t nBlocksWaitingForParentSize = 0;
+
 /** Number of blocks in flight with validated headers. */
 int nQueuedValidatedHeaders = 0;
 
@@ -314,6 +357,15 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! The compact block from this peer waiting for the blocktxn we asked for.
+    uint256 hashPartialBlock;
+    std::shared_ptr<CPartiallyDownloadedBlock> partialBlock;
+    //! Headers new to us from this peer that claim more work than our tip, until their blocks arrive.
+    std::deque<CBlockIndex*> vHeadersWithoutData;
+    //! When vHeadersWithoutData last shrank, or got its first entry (in seconds).
+    int64_t nHeadersDataProgress;
+    //! Whether we stopped asking this peer for headers because of MAX_HEADERS_WITHOUT_DATA.
+    bool fHeadersCapped;
 
     CNodeBlocks nodeBlocks;
 
@@ -329,6 +381,9 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        hashPartialBlock = uint256(0);
+        nHeadersDataProgress = 0;
+        fHeadersCapped = false;
     }
 };
 
@@ -374,6 +429,20 @@ void InitializeNode(NodeId nodeid, const CNode* pnode)
     state.address = pnode->addr;
 }
 
+// Requires cs_main. Recompute pindexBestHeader after headers without blocks were dropped.
+void static ResetBestHeader()
+{
+    pindexBestHeader = chainActive.Tip();
+    if (!setBlockIndexCandidates.empty() && (pindexBestHeader == NULL || (*setBlockIndexCandidates.rbegin())->nChainWork > pindexBestHeader->nChainWork))
+        pindexBestHeader = *setBlockIndexCandidates.rbegin();
+    for (const std::pair<const NodeId, CNodeState>& entry : mapNodeState) {
+        for (CBlockIndex* pindex : entry.second.vHeadersWithoutData) {
+            if (pindexBestHeader == NULL || pindex->nChainWork > pindexBestHeader->nChainWork)
+                pindexBestHeader = pindex;
+        }
+    }
+}
+
 void FinalizeNode(NodeId nodeid)
 {
     LOCK(cs_main);
@@ -390,10 +459,16 @@ void FinalizeNode(NodeId nodeid)
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    bool fHadHeadersWithoutData = !state->vHeadersWithoutData.empty();
 
     mapNodeState.erase(nodeid);
+
+    // Headers only this peer vouched for no longer count towards our best header
+    if (fHadHeadersWithoutData)
+        ResetBestHeader();
 }
 
+// Requires cs_main.
 // Requires cs_main.
 void MarkBlockAsReceived(const uint256& hash)
 {
@@ -538,9 +613,11 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                 // We consider the chain that this peer is on invalid.
                 return;
             }
-            if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            if (pindex->nStatus & BLOCK_HAVE_DATA || chainActive.Contains(pindex)) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
+            } else if (mapBlocksWaitingForParent.count(pindex->GetBlockHash())) {
+                // Downloaded already, and accepted once its parent is
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
                 if (pindex->nHeight > nWindowEnd) {
@@ -565,6 +642,24 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
 
 } // anon namespace
 
+bool static HeaderResolved(const CBlockIndex* pindex)
+{
+    return (pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)) || chainActive.Contains(pindex) ||
+           (chainActive.Tip() && pindex->nChainWork <= chainActive.Tip()->nChainWork);
+}
+
+bool PruneHeadersWithoutData(std::deque<CBlockIndex*>& vHeaders, bool fAll)
+{
+    size_t nBefore = vHeaders.size();
+    if (fAll) {
+        vHeaders.erase(std::remove_if(vHeaders.begin(), vHeaders.end(), HeaderResolved), vHeaders.end());
+    } else {
+        while (!vHeaders.empty() && HeaderResolved(vHeaders.front()))
+            vHeaders.pop_front();
+    }
+    return vHeaders.size() < nBefore;
+}
+
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats)
 {
     LOCK(cs_main);
@@ -614,6 +709,13 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewDB* pcoinsdbview = NULL;
+CCoinsViewAsyncWriter* pcoinsWriter = NULL;
+CBlockFileWriter* pblockWriter = NULL;
+CMessageWorkers* pmessageWorkers = NULL;
+//! Where the statistics of the UTXO set at the tip are persisted, if they are kept
+static CCoinsViewDB* pcoinsStatsDB = NULL;
+static CCoinsRunningStats coinsStatsTip;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
 CSporkDB* pSporkDB = NULL;
@@ -1072,7 +1174,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
 }
 
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack)
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1147,12 +1249,15 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
                     return state.DoS(100, error("%s: Zerocoinspend could not find accumulator associated with checksum %s", __func__, HexStr(BEGIN(nChecksum), END(nChecksum))));
                 }
 
-                libzerocoin::Accumulator accumulator(Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()),
-                                        newSpend.getDenomination(), bnAccumulatorValue);
-
-                //Check that the coin has been accumulated
-                if(!newSpend.Verify(accumulator, !fFakeSerialAttack))
-                        return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+                CZerocoinSpendCheck check(newSpend, Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start()),
+                                          bnAccumulatorValue, !fFakeSerialAttack);
+                if (pvSpendChecks) {
+                    pvSpendChecks->push_back(CZerocoinSpendCheck());
+                    check.swap(pvSpendChecks->back());
+                } else if (!check()) {
+                    //Check that the coin has been accumulated
+                    return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
+                }
             }
 
         if (serials.count(newSpend.getCoinSerialNumber()))
@@ -1172,7 +1277,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack, std::vector<CZerocoinSpendCheck>* pvSpendChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1242,7 +1347,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state, fFakeSerialAttack))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, fFakeSerialAttack, pvSpendChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1861,14 +1966,33 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
                 CBlockHeader header;
                 try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
+                    unsigned int nOffset;
+                    std::shared_ptr<const std::vector<char> > pending;
+                    if (pblockWriter)
+                        pending = pblockWriter->GetPending(postx, false, nOffset);
+                    std::shared_ptr<const CMappedFile> mapped;
+                    if (!pending)
+                        mapped = MapFinalizedBlockFile(postx.nFile);
+                    if (pending) {
+                        CSpanReader file((const unsigned char*)pending->data() + nOffset, (const unsigned char*)pending->data() + pending->size(), SER_DISK, CLIENT_VERSION);
+                        file >> header;
+                        file.ignore(postx.nTxOffset);
+                        file >> txOut;
+                    } else if (mapped) {
+                        CSpanReader file = mapped->GetReader(postx.nPos, SER_DISK, CLIENT_VERSION);
+                        file >> header;
+                        file.ignore(postx.nTxOffset);
+                        file >> txOut;
+                    } else {
+                        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                        if (file.IsNull())
+                            return error("%s: OpenBlockFile failed", __func__);
+                        file >> header;
+                        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                        file >> txOut;
+                    }
                 } catch (std::exception& e) {
                     return error("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
@@ -1919,6 +2043,19 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
 
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
 {
+    if (pblockWriter) {
+        // The block goes right after its index header at the position reserved for it
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        unsigned int nSize = ssBlock.GetSerializeSize(block);
+        ssBlock << FLATDATA(Params().MessageStart()) << nSize << block;
+        std::vector<char> vData(ssBlock.begin(), ssBlock.end());
+        CDiskBlockPos posHeader = pos;
+        pos.nPos += vData.size() - nSize;
+        if (!pblockWriter->Write(posHeader, false, vData))
+            return error("WriteBlockToDisk : block file writer failed");
+        return true;
+    }
+
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
@@ -1938,18 +2075,45 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
+std::shared_ptr<const CMappedFile> MapFinalizedBlockFile(int nFile)
+{
+    if (!fBlockMmap)
+        return std::shared_ptr<const CMappedFile>();
+    {
+        // The last block file is still appended to
+        LOCK(cs_LastBlockFile);
+        if (nFile >= nLastBlockFile)
+            return std::shared_ptr<const CMappedFile>();
+    }
+    return blockFileMaps.Get(nFile);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read block, straight from memory if it is still queued to be written or the file is mapped
     try {
-        filein >> block;
+        unsigned int nOffset;
+        std::shared_ptr<const std::vector<char> > pending;
+        if (pblockWriter)
+            pending = pblockWriter->GetPending(pos, false, nOffset);
+        std::shared_ptr<const CMappedFile> mapped;
+        if (!pending)
+            mapped = MapFinalizedBlockFile(pos.nFile);
+        if (pending) {
+            CSpanReader filein((const unsigned char*)pending->data() + nOffset, (const unsigned char*)pending->data() + pending->size(), SER_DISK, CLIENT_VERSION);
+            filein >> block;
+        } else if (mapped) {
+            CSpanReader filein = mapped->GetReader(pos.nPos, SER_DISK, CLIENT_VERSION);
+            filein >> block;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk : OpenBlockFile failed");
+            filein >> block;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -1963,7 +2127,7 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+bool static ReadBlockFromDiskUncached(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
@@ -1974,6 +2138,44 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool static IsBlockCacheDepth(const CBlockIndex* pindex)
+{
+    return pindex->nHeight + BLOCK_CACHE_DEPTH > nBlockCacheTipHeight;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
+{
+    std::shared_ptr<const CBlock> pblockCached = blockCache.Get(pindex->GetBlockHash());
+    if (pblockCached) {
+        block = *pblockCached;
+        return true;
+    }
+
+    if (!ReadBlockFromDiskUncached(block, pindex))
+        return false;
+    if (IsBlockCacheDepth(pindex)) {
+        block.BuildMerkleTree();
+        blockCache.Insert(pindex->GetBlockHash(), std::make_shared<const CBlock>(block));
+    }
+    return true;
+}
+
+std::shared_ptr<const CBlock> ReadBlockShared(const CBlockIndex* pindex)
+{
+    std::shared_ptr<const CBlock> pblockCached = blockCache.Get(pindex->GetBlockHash());
+    if (pblockCached)
+        return pblockCached;
+
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    if (!ReadBlockFromDiskUncached(*pblock, pindex))
+        return std::shared_ptr<const CBlock>();
+    if (IsBlockCacheDepth(pindex)) {
+        pblock->BuildMerkleTree();
+        blockCache.Insert(pindex->GetBlockHash(), pblock);
+    }
+    return pblock;
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -2225,6 +2427,82 @@ bool CScriptCheck::operator()()
     return true;
 }
 
+namespace {
+
+/**
+ * Valid zerocoin spend cache, to avoid verifying the expensive spend proofs twice
+ * for every private spend (once when accepted into memory pool, and again when
+ * accepted into the block chain)
+ */
+class CZerocoinSpendCache
+{
+private:
+    //! salted hash of (spend, accumulator modulus, accumulator value, params verification flag)
+    std::set<uint256> setValid;
+    uint256 nonce;
+    boost::shared_mutex cs_spendcache;
+
+public:
+    CZerocoinSpendCache()
+    {
+        nonce = GetRandHash();
+    }
+
+    uint256 ComputeEntry(const libzerocoin::CoinSpend& spend, const libzerocoin::ZerocoinParams* params, const CBigNum& bnAccumulatorValue, bool fVerifyParams)
+    {
+        // The salt keeps entries unpredictable, so an attacker can not aim spends at a
+        // specific part of the set to game the random eviction below. The modulus tells
+        // the V1 and V2 parameters apart, a spend is only valid under the ones it was checked with.
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << nonce << spend << params->accumulatorParams.accumulatorModulus << bnAccumulatorValue << fVerifyParams;
+        return ss.GetHash();
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_spendcache);
+        return setValid.count(entry) != 0;
+    }
+
+    void Set(const uint256& entry)
+    {
+        // A block can hold at most a few hundred private spends and every entry is
+        // a single hash, so the default keeps the cache well below 1MB.
+        int64_t nMaxCacheSize = GetArg("-maxzcspendcachesize", DEFAULT_MAX_ZC_SPEND_CACHE_SIZE);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_spendcache);
+
+        while (static_cast<int64_t>(setValid.size()) >= nMaxCacheSize) {
+            // Evict a random entry, see CSignatureCache
+            std::set<uint256>::iterator it = setValid.lower_bound(GetRandHash());
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(it);
+        }
+
+        setValid.insert(entry);
+    }
+};
+
+CZerocoinSpendCache zerocoinSpendCache;
+
+}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    uint256 entry = zerocoinSpendCache.ComputeEntry(spend, params, bnAccumulatorValue, fVerifyParams);
+    if (zerocoinSpendCache.Get(entry))
+        return true;
+
+    libzerocoin::Accumulator accumulator(params, spend.getDenomination(), bnAccumulatorValue);
+    if (!spend.Verify(accumulator, fVerifyParams))
+        return ::error("CZerocoinSpendCheck(): zerocoin spend with serial %s did not verify", spend.getCoinSerialNumber().GetHex());
+
+    zerocoinSpendCache.Set(entry);
+    return true;
+}
+
 CBitcoinAddress addressExp1("DQZzqnSR6PXxagep1byLiRg9ZurCZ5KieQ");
 CBitcoinAddress addressExp2("DTQYdnNqKuEHXyNeeYhPQGGGdqHbXYwjpj");
 
@@ -2412,7 +2690,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, CCoinsRunningStats* pstats)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -2512,6 +2790,14 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if (*outs != outsBlock)
                 fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
+            if (pstats && !outs->IsPruned()) {
+                pstats->nTransactions--;
+                for (unsigned int n = 0; n < outs->vout.size(); n++) {
+                    if (outs->IsAvailable(n))
+                        pstats->RemoveOutput(COutPoint(hash, n), *outs, outs->vout[n]);
+                }
+            }
+
             // remove outputs
             outs->Clear();
         }
@@ -2542,6 +2828,11 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 if (coins->vout.size() < out.n + 1)
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
+                if (pstats) {
+                    if (undo.nHeight != 0)
+                        pstats->nTransactions++;
+                    pstats->AddOutput(out, *coins, undo.txout);
+                }
             }
         }
     }
@@ -2556,6 +2847,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if(!EraseAccumulatorValues(nCheckpoint, pindex->pprev->nAccumulatorCheckpoint))
                 return error("DisconnectBlock(): failed to erase checkpoint");
         }
+
+        if (pindex->nHeight >= Params().Zerocoin_StartHeight() && !zerocoinDB->EraseBlockMints(pindex->GetBlockHash()))
+            return error("DisconnectBlock(): failed to erase block pubcoins");
     }
 
     if (pfClean) {
@@ -2570,6 +2864,11 @@ void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
+    // Queued blocks and undo data reach their files before these are truncated or
+    // the block index refers to them; failures are reported through HasFailed
+    if (pblockWriter)
+        pblockWriter->Flush();
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
     FILE* fileOld = OpenBlockFile(posOld);
@@ -2599,6 +2898,14 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+static CSharedCheckQueue<CZerocoinSpendCheck> zerocoinspendcheckqueue;
+
+void ThreadZerocoinSpendCheck()
+{
+    RenameThread("nodezero-zspendch");
+    zerocoinspendcheckqueue.Thread();
+}
+
 void AddWrappedSerialsInflation()
 {
     CBlockIndex* pindex = chainActive[Params().Zerocoin_Block_EndFakeSerial()];
@@ -2615,7 +2922,7 @@ void AddWrappedSerialsInflation()
 
         // Add inflated denominations to block index mapSupply
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+            pindex->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
         }
         // Update current block index to disk
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2678,22 +2985,22 @@ void RecalculateZNZRSpent()
         std::list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+        pindex->zerocoinSupply = pindex->pprev->zerocoinSupply;
 
         //Add mints to zNZR supply
         for (auto denom : libzerocoin::zerocoinDenomList) {
             long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+            pindex->zerocoinSupply.at(denom) += nDenomAdded;
         }
 
         //Remove spends from zNZR supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->zerocoinSupply.at(denom)--;
 
         // Add inflation from Wrapped Serials if block is Zerocoin_Block_EndFakeSerial()
         if (pindex->nHeight == Params().Zerocoin_Block_EndFakeSerial() + 1)
             for (auto denom : libzerocoin::zerocoinDenomList) {
-                pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+                pindex->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
             }
 
         //Rewrite money supply
@@ -2842,7 +3149,7 @@ bool UpdateZNZRSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
     // Initialize zerocoin supply to the supply from previous block
     if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 3) {
         for (auto& denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
+            pindex->zerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
         }
     }
 
@@ -2854,7 +3161,7 @@ bool UpdateZNZRSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
             pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            pindex->zerocoinSupply.at(denom)++;
 
             //Remove any of our own mints from the mintpool
             if (!fJustCheck && pwalletMain) {
@@ -2879,7 +3186,7 @@ bool UpdateZNZRSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->zerocoinSupply.at(denom)--;
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
@@ -2889,14 +3196,14 @@ bool UpdateZNZRSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
     }
 
     for (auto& denom : libzerocoin::zerocoinDenomList)
-        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->zerocoinSupply.at(denom));
 
     // Update Wrapped Serials amount
     // A one-time event where only the zNZR supply was off (due to serial duplication off-chain on main net)
     if (Params().NetworkID() == CBaseChainParams::MAIN && pindex->nHeight == Params().Zerocoin_Block_EndFakeSerial() + 1
             && pindex->GetZerocoinSupply() < Params().GetSupplyBeforeFakeSerial() + GetWrapppedSerialInflationAmount()) {
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+            pindex->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
         }
     }
     return true;
@@ -2908,7 +3215,7 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked, CCoinsRunningStats* pstats)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -3113,11 +3420,35 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
         nValueOut += tx.GetValueOut();
 
+        if (pstats && !tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
+            for (const CTxIn& txin : tx.vin) {
+                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+                pstats->RemoveOutput(txin.prevout, *coins, coins->vout[txin.prevout.n]);
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
-        UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        CTxUndo& txundo = i == 0 ? undoDummy : blockundo.vtxundo.back();
+        UpdateCoins(tx, state, view, txundo, pindex->nHeight);
+
+        if (pstats) {
+            // The undo data holds the metadata of the transactions this one spent completely
+            for (const CTxInUndo& undo : txundo.vprevout) {
+                if (undo.nHeight != 0)
+                    pstats->nTransactions--;
+            }
+            const CCoins* coins = view.AccessCoins(tx.GetHash());
+            if (coins && !coins->IsPruned()) {
+                pstats->nTransactions++;
+                for (unsigned int n = 0; n < coins->vout.size(); n++) {
+                    if (coins->IsAvailable(n))
+                        pstats->AddOutput(COutPoint(tx.GetHash(), n), *coins, coins->vout[n]);
+                }
+            }
+        }
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
@@ -3235,6 +3566,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Flush spend/mint info to disk
     if (!zerocoinDB->WriteCoinSpendBatch(vSpends)) return state.Abort(("Failed to record coin serials to database"));
     if (!zerocoinDB->WriteCoinMintBatch(vMints)) return state.Abort(("Failed to record new mints to database"));
+    if (!vMints.empty() && !IndexBlockPubcoins(block, pindex)) return state.Abort(("Failed to record block pubcoins to database"));
 
     //Record accumulator checksums
     DatabaseChecksums(mapAccumulators);
@@ -3273,7 +3605,202 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     return true;
 }
 
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+void PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex)
+                    mapBlocksUnlinked.erase(itUnlinked);
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+    mapBlockFilePruneChecks.erase(fileNumber);
+    blockFileMaps.Erase(fileNumber);
+}
+
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+{
+    for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+enum BlockFileRetention {
+    RETAIN_NONE,    //! nothing in the file is needed anymore
+    RETAIN_UNSPENT, //! the file holds transactions with unspent outputs
+    RETAIN_ALWAYS,  //! the file holds data that is needed for good
+};
+
+/**
+ * What the blocks of a file hold that must stay readable after they were connected.
+ * Everything is looked up through GetTransaction, which reads the block file:
+ * - previous transactions of unspent outputs, for coinstake kernels, masternode
+ *   collateral and SwiftX inputs, and zerocoin mints, whose outputs are never spent
+ * - zerocoin spends, which the serial double spend check finds in the chain
+ * - budget collateral, which proposals and finalized budgets are checked against
+ * vUnspentTxids is set to the transactions with unspent outputs. A file that was
+ * checked before is not read again: outputs only get spent, so only the
+ * transactions pcheckPrev found unspent are looked up. A block that cannot be
+ * read gives RETAIN_UNSPENT without transactions.
+ */
+BlockFileRetention static GetBlockFileRetention(const std::vector<CBlockIndex*>& vBlocks, const CBlockFilePruneCheck* pcheckPrev, std::vector<uint256>& vUnspentTxids)
+{
+    // Lookups go past the coins cache, so that a check does not fill it with old transactions
+    vUnspentTxids.clear();
+    if (pcheckPrev) {
+        for (const uint256& txid : pcheckPrev->vUnspentTxids) {
+            if (pcoinsTip->HaveCoinsUncached(txid))
+                vUnspentTxids.push_back(txid);
+        }
+        return vUnspentTxids.empty() ? RETAIN_NONE : RETAIN_UNSPENT;
+    }
+
+    for (const CBlockIndex* pindex : vBlocks) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex))
+            return RETAIN_UNSPENT;
+        for (const CTransaction& tx : block.vtx) {
+            if (tx.HasZerocoinSpendInputs())
+                return RETAIN_ALWAYS;
+            for (const CTxOut& txout : tx.vout) {
+                const CScript& script = txout.scriptPubKey;
+                if (script.size() == 34 && script[0] == OP_RETURN && script[1] == 32)
+                    return RETAIN_ALWAYS;
+            }
+            // Only blocks of the active chain can have outputs in the UTXO set
+            if (chainActive.Contains(pindex) && pcoinsTip->HaveCoinsUncached(tx.GetHash()))
+                vUnspentTxids.push_back(tx.GetHash());
+        }
+    }
+    return vUnspentTxids.empty() ? RETAIN_NONE : RETAIN_UNSPENT;
+}
+
+/**
+ * Prune block and undo files (blk???.dat and rev???.dat) so that the disk space used is less than a user-defined target.
+ * The user sets the target (in MiB) on the command line or in config file. This will be run on startup and whenever new
+ * space is allocated in a block or undo file, staying below the target. Changing back to unpruned requires a reindex
+ * (which in this case means the blockchain must be re-downloaded.)
+ *
+ * Pruning functions are called from FlushStateToDisk when the global fCheckForPruning flag has been set.
+ * Block and undo files are deleted in lock-step (when blk00003.dat is deleted, so is rev00003.dat.)
+ * Pruning cannot take place until the longest chain is at least a certain length (MIN_BLOCKS_TO_KEEP).
+ * The last MIN_BLOCKS_TO_KEEP blocks are kept, as are files holding data that GetBlockFileRetention reports.
+ * A file is only pruned after it was found to hold nothing to retain twice, MIN_BLOCKS_TO_KEEP blocks apart,
+ * so that no reorganization can bring back outputs whose previous transaction is gone.
+ *
+ * @param[out]   setFilesToPrune   The set of file indices that can be unlinked will be returned
+ */
+void static FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL || nPruneTarget == 0)
+        return;
+    if (chainActive.Tip()->nHeight <= (int)MIN_BLOCKS_TO_KEEP)
+        return;
+
+    int nTipHeight = chainActive.Tip()->nHeight;
+    unsigned int nLastBlockWeCanPrune = nTipHeight - MIN_BLOCKS_TO_KEEP;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    // We don't check to prune until after we've allocated new space for files
+    // So we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    if (nCurrentUsage + nBuffer < nPruneTarget)
+        return;
+
+    // Blocks of the files that are old enough to be pruned
+    std::map<int, std::vector<CBlockIndex*> > mapFileBlocks;
+    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+        if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+            continue;
+        if (setBlockFilesRetained.count(fileNumber))
+            continue;
+        std::map<int, CBlockFilePruneCheck>::const_iterator it = mapBlockFilePruneChecks.find(fileNumber);
+        if (it != mapBlockFilePruneChecks.end() && nTipHeight < it->second.nHeight + (int)MIN_BLOCKS_TO_KEEP)
+            continue;
+        mapFileBlocks[fileNumber];
+    }
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            std::map<int, std::vector<CBlockIndex*> >::iterator itFile = mapFileBlocks.find(pindex->nFile);
+            if (itFile != mapFileBlocks.end())
+                itFile->second.push_back(pindex);
+        }
+    }
+
+    int nChecked = 0;
+    for (std::map<int, std::vector<CBlockIndex*> >::iterator it = mapFileBlocks.begin(); it != mapFileBlocks.end(); ++it) {
+        if (nCurrentUsage + nBuffer < nPruneTarget)
+            break;
+
+        int fileNumber = it->first;
+        nChecked++;
+        std::map<int, CBlockFilePruneCheck>::iterator itCheck = mapBlockFilePruneChecks.find(fileNumber);
+        std::vector<uint256> vUnspentTxids;
+        BlockFileRetention retention = GetBlockFileRetention(it->second, itCheck != mapBlockFilePruneChecks.end() ? &itCheck->second : NULL, vUnspentTxids);
+        if (retention == RETAIN_ALWAYS) {
+            setBlockFilesRetained.insert(fileNumber);
+            mapBlockFilePruneChecks.erase(fileNumber);
+            continue;
+        }
+        if (retention == RETAIN_NONE && itCheck != mapBlockFilePruneChecks.end() && itCheck->second.fPrunable) {
+            uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
+            PruneOneBlockFile(fileNumber);
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+        } else if (retention == RETAIN_UNSPENT && vUnspentTxids.empty()) {
+            // The file could not be read, so there is nothing to base the next check on
+            mapBlockFilePruneChecks.erase(fileNumber);
+        } else {
+            CBlockFilePruneCheck check;
+            check.nHeight = nTipHeight;
+            check.fPrunable = retention == RETAIN_NONE;
+            check.vUnspentTxids.swap(vUnspentTxids);
+            mapBlockFilePruneChecks[fileNumber] = check;
+        }
+    }
+
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d checked=%d retained=%u removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, nChecked, setBlockFilesRetained.size(), setFilesToPrune.size());
+}
+
 enum FlushStateMode {
+    FLUSH_STATE_NONE,
     FLUSH_STATE_IF_NEEDED,
     FLUSH_STATE_PERIODIC,
     FLUSH_STATE_ALWAYS
@@ -3283,14 +3810,31 @@ enum FlushStateMode {
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
  * fast is not set and it's been a while since the last write.
+ * With pcoinsWriter set, only FLUSH_STATE_ALWAYS and flushes that prune wait for the
+ * chainstate to be written; otherwise it is written in the background while validation continues.
  */
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+        if (pcoinsWriter && pcoinsWriter->HasFailed())
+            return state.Abort("Failed to write to coin database");
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
@@ -3301,6 +3845,8 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
+            if (pblockWriter && pblockWriter->HasFailed())
+                return state.Abort("Failed to write to block files");
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -3319,9 +3865,18 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                     return state.Abort("Files to write to block index database");
                 }
             }
-            // Finally flush the chainstate (which may refer to block index entries).
+            // Finally flush the chainstate (which may refer to block index entries),
+            // along with the statistics of the UTXO set it holds.
+            if (pcoinsStatsDB && coinsStatsTip.hashBlock == pcoinsTip->GetBestBlock())
+                pcoinsStatsDB->SetBlockStats(coinsStatsTip);
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            if (pcoinsWriter && (mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinsWriter->Sync())
+                return state.Abort("Failed to write to coin database");
+            // Only remove the files the block index no longer refers to once the chainstate
+            // is on disk, as it could otherwise need them to be reconnected from after a crash
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -3334,16 +3889,40 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     return true;
 }
 
+void InitCoinsStats(CCoinsViewDB* pdb, const CCoinsRunningStats& stats)
+{
+    LOCK(cs_main);
+    pcoinsStatsDB = pdb;
+    coinsStatsTip = stats;
+}
+
+bool GetTipCoinsStats(CCoinsStats& stats)
+{
+    LOCK(cs_main);
+    if (!pcoinsStatsDB)
+        return false;
+    coinsStatsTip.GetStats(stats);
+    return true;
+}
+
 void FlushStateToDisk()
 {
     CValidationState state;
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush()
+{
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    nBlockCacheTipHeight = pindexNew->nHeight;
 
     /* Zerocoin minting is disabled
      *
@@ -3359,10 +3938,10 @@ void static UpdateTip(CBlockIndex* pindexNew)
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d version=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d version=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utx)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), chainActive.Tip()->nVersion, log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -3401,9 +3980,15 @@ bool static DisconnectTip(CValidationState& state)
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (!DisconnectBlock(block, state, pindexDelete, view))
+        CCoinsRunningStats statsDelta;
+        if (!DisconnectBlock(block, state, pindexDelete, view, NULL, pcoinsStatsDB ? &statsDelta : NULL))
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
+        if (pcoinsStatsDB) {
+            coinsStatsTip.Apply(statsDelta);
+            coinsStatsTip.hashBlock = pindexDelete->pprev->GetBlockHash();
+            coinsStatsTip.nHeight = pindexDelete->pprev->nHeight;
+        }
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
@@ -3463,7 +4048,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
+        CCoinsRunningStats statsDelta;
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked, pcoinsStatsDB ? &statsDelta : NULL);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -3475,6 +4061,11 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
+        if (pcoinsStatsDB) {
+            coinsStatsTip.Apply(statsDelta);
+            coinsStatsTip.hashBlock = pindexNew->GetBlockHash();
+            coinsStatsTip.nHeight = pindexNew->nHeight;
+        }
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
@@ -3496,6 +4087,14 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     mempool.check(pcoinsTip);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    // Keep the block for readers of recent blocks, unless it was just read into the cache.
+    // Nobody asks for recent blocks during initial download, so skip the copy then.
+    if (!IsInitialBlockDownload() && !blockCache.Contains(pindexNew->GetBlockHash())) {
+        std::shared_ptr<CBlock> pblockShared = std::make_shared<CBlock>(*pblock);
+        if (pblockShared->vMerkleTree.empty())
+            pblockShared->BuildMerkleTree();
+        blockCache.Insert(pindexNew->GetBlockHash(), pblockShared);
+    }
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     for (const CTransaction& tx : txConflicted) {
@@ -3781,11 +4380,30 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             uint256 hashNewTip = pindexNewTip->GetBlockHash();
             // Relay inventory, but don't relay old inventory during initial block download.
             int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
+            // Peers that rebuild blocks from their mempool get the new tip right away as a compact block
+            std::unique_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
+            if (pblock && pblock->GetHash() == hashNewTip && (nLocalServices & NODE_COMPACT_BLOCKS))
+                pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock));
             {
                 LOCK(cs_vNodes);
-                for (CNode* pnode : vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                for (CNode* pnode : vNodes) {
+                    if (chainActive.Height() <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                        continue;
+                    CInv inv(MSG_BLOCK, hashNewTip);
+                    if (pcmpctblock && (pnode->nServices & NODE_COMPACT_BLOCKS) && pnode->fSuccessfullyConnected) {
+                        bool fKnown;
+                        {
+                            LOCK(pnode->cs_inventory);
+                            fKnown = pnode->setInventoryKnown.count(inv);
+                        }
+                        if (!fKnown) {
+                            pnode->AddInventoryKnown(inv);
+                            pnode->PushMessage("cmpctblock", *pcmpctblock);
+                        }
+                        continue;
+                    }
+                    pnode->PushInventory(inv);
+                }
             }
             // Notify external listeners about the new tip.
             // Note: uiInterface, should switch main signals.
@@ -3880,6 +4498,49 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex* pindex)
     return true;
 }
 
+/**
+ * Fill in the proof-of-stake fields of a block index, which need the transactions
+ * of the block and the stake fields of its parent. Done when the block is added to
+ * the index, or, for a block first known from its header, when its data arrives.
+ */
+void static SetBlockIndexStake(CBlockIndex* pindexNew, const CBlock& block)
+{
+    uint256 hash = block.GetHash();
+    if (block.IsProofOfStake()) {
+        pindexNew->SetProofOfStake();
+        pindexNew->prevoutStake = block.vtx[1].vin[0].prevout;
+        pindexNew->nStakeTime = block.nTime;
+    }
+
+    // ppcoin: compute chain trust score
+    pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
+
+    // ppcoin: compute stake entropy bit for stake modifier
+    if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
+        LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
+
+    // ppcoin: record proof-of-stake hash value
+    if (pindexNew->IsProofOfStake()) {
+        if (!mapProofOfStake.count(hash))
+            LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
+        pindexNew->hashProofOfStake = mapProofOfStake[hash];
+    }
+
+    if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
+        uint64_t nStakeModifier = 0;
+        bool fGeneratedStakeModifier = false;
+        if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
+            LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
+        pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
+        if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
+            LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, std::to_string(nStakeModifier));
+    } else {
+        // compute v2 stake modifier
+        pindexNew->nStakeModifierV2 = ComputeStakeModifier(pindexNew->pprev, block.vtx[1].vin[0].prevout.hash);
+    }
+}
+
 CBlockIndex* AddToBlockIndex(const CBlock& block)
 {
     // Check for duplicate
@@ -3907,33 +4568,9 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
-        // ppcoin: compute chain trust score
-        pindexNew->bnChainTrust = (pindexNew->pprev ? pindexNew->pprev->bnChainTrust : 0) + pindexNew->GetBlockTrust();
-
-        // ppcoin: compute stake entropy bit for stake modifier
-        if (!pindexNew->SetStakeEntropyBit(pindexNew->GetStakeEntropyBit()))
-            LogPrintf("AddToBlockIndex() : SetStakeEntropyBit() failed \n");
-
-        // ppcoin: record proof-of-stake hash value
-        if (pindexNew->IsProofOfStake()) {
-            if (!mapProofOfStake.count(hash))
-                LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
-        }
-
-        if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
-            uint64_t nStakeModifier = 0;
-            bool fGeneratedStakeModifier = false;
-            if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
-                LogPrintf("AddToBlockIndex() : ComputeNextStakeModifier() failed \n");
-            pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
-            pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
-            if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
-                LogPrintf("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=%s \n", pindexNew->nHeight, std::to_string(nStakeModifier));
-        } else {
-            // compute v2 stake modifier
-            pindexNew->nStakeModifierV2 = ComputeStakeModifier(pindexNew->pprev, block.vtx[1].vin[0].prevout.hash);
-        }
+        // A header carries no stake; that part is filled in once the block data arrives
+        if (!block.vtx.empty())
+            SetBlockIndexStake(pindexNew, block);
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
@@ -4030,6 +4667,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
@@ -4060,6 +4699,8 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
@@ -4253,15 +4894,21 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     std::vector<CBigNum> vBlockSerials;
     // TODO: Check if this is ok... blockHeight is always the tip or should we look for the prevHash and get the height?
     int blockHeight = chainActive.Height() + 1;
+
+    // Spread the zerocoin spend proof verifications over the check threads
+    CCheckQueueTryControl<CZerocoinSpendCheck> control(zerocoinspendcheckqueue, nScriptCheckThreads);
     for (const CTransaction& tx : block.vtx) {
+        std::vector<CZerocoinSpendCheck> vSpendChecks;
         if (!CheckTransaction(
                 tx,
                 fZerocoinActive,
                 blockHeight >= Params().Zerocoin_Block_EnforceSerialRange(),
                 state,
-                isBlockBetweenFakeSerialAttackRange(blockHeight)
+                isBlockBetweenFakeSerialAttackRange(blockHeight),
+                control.IsQueued() ? &vSpendChecks : NULL
         ))
             return error("%s : CheckTransaction failed", __func__);
+        control.Add(vSpendChecks);
 
         // double check that there are no double spent zNZR spends in this block
         if (tx.HasZerocoinSpendInputs()) {
@@ -4298,6 +4945,10 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, error("%s : out-of-bounds SigOpCount", __func__),
             REJECT_INVALID, "bad-blk-sigops", true);
 
+    if (!control.Wait())
+        return state.DoS(100, error("%s : zerocoin spend did not verify", __func__),
+            REJECT_INVALID, "bad-txns-zc-spend");
+
     return true;
 }
 
@@ -4325,6 +4976,20 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
     return true;
 }
 
+bool CheckHeaderWork(const CBlockHeader& header, const CBlockIndex* pindexPrev)
+{
+    unsigned int nBitsRequired = GetNextWorkRequired(pindexPrev, &header);
+
+    // Before the DGW fork proof-of-work blocks may be off by half, see CheckWork
+    if ((Params().NetworkID() != CBaseChainParams::REGTEST) && (pindexPrev->nHeight + 1 <= 68589)) {
+        double n1 = ConvertBitsToDouble(header.nBits);
+        double n2 = ConvertBitsToDouble(nBitsRequired);
+        return std::abs(n1 - n2) <= n1 * 0.5;
+    }
+
+    return header.nBits == nBitsRequired;
+}
+
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* const pindexPrev)
 {
     uint256 hash = block.GetHash();
@@ -4530,6 +5195,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
             mapProofOfStake.insert(std::make_pair(hash, hashProofOfStake));
     }
 
+    bool fHeaderKnown = mapBlockIndex.count(block.GetHash()) > 0;
     if (!AcceptBlockHeader(block, state, &pindex))
         return false;
 
@@ -4540,6 +5206,10 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         return true;
     }
 
+    // The block was first known from its header, and its parent has been accepted since
+    if (fHeaderKnown)
+        SetBlockIndexStake(pindex, block);
+
     if ((!fAlreadyCheckedBlock && !CheckBlock(block, state)) || !ContextualCheckBlock(block, state, pindex->pprev)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -4838,6 +5508,21 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+bool AddBlockWaitingForParent(NodeId nodeid, const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = block.GetHash();
+    size_t nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    if (mapBlocksWaitingForParent.count(hash) || mapBlocksWaitingForParent.size() >= BLOCK_DOWNLOAD_WINDOW ||
+        nBlocksWaitingForParentSize + nSize > MAX_BLOCKS_WAITING_FOR_PARENT_SIZE)
+        return false;
+
+    mapBlocksWaitingForParent.insert(std::make_pair(hash, std::make_pair(nodeid, block)));
+    mapBlocksWaitingByParent.insert(std::make_pair(block.hashPrevBlock, hash));
+    nBlocksWaitingForParentSize += nSize;
+    return true;
+}
+
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
 {
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != NULL) {
@@ -4861,11 +5546,27 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     {
         LOCK(cs_main);
 
+        std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(pblock->GetHash());
+        bool fRequested = pfrom && itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
         MarkBlockAsReceived(pblock->GetHash());
         if (!checked) {
             return error ("%s : CheckBlock FAILED for block %s", __func__, pblock->GetHash().GetHex());
         }
 
+        // The parent is only known from its header: this block can be checked against its
+        // stake once the parent is accepted, see ProcessBlocksWaitingForParent
+        if (pfrom) {
+            BlockMap::iterator miPrev = mapBlockIndex.find(pblock->hashPrevBlock);
+            if (miPrev != mapBlockIndex.end() && !(miPrev->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK)) && !chainActive.Contains(miPrev->second)) {
+                uint256 hash = pblock->GetHash();
+                // Only blocks we asked for are kept, and past the download window they are dropped
+                // and asked for again later
+                if (fRequested && AddBlockWaitingForParent(pfrom->GetId(), *pblock))
+                    LogPrint("net", "%s : block %s waits for its parent %s\n", __func__, hash.ToString(), pblock->hashPrevBlock.ToString());
+                return true;
+            }
+        }
+
         // Store to disk
         CBlockIndex* pindex = nullptr;
         bool ret = AcceptBlock(*pblock, state, &pindex, dbp, checked);
@@ -4923,6 +5624,54 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     return true;
 }
 
+/**
+ * Accept the blocks that were waiting for hashParent, and in turn the blocks waiting
+ * for those. The children of a parent that turned out invalid are dropped.
+ */
+void static ProcessBlocksWaitingForParent(const uint256& hashParent)
+{
+    // Parents, and whether their waiting children are dropped
+    std::deque<std::pair<uint256, bool> > queueParents(1, std::make_pair(hashParent, false));
+    while (!queueParents.empty()) {
+        uint256 hash = queueParents.front().first;
+        bool fParentFailed = queueParents.front().second;
+        queueParents.pop_front();
+
+        std::vector<CBlock> vBlocks;
+        {
+            LOCK(cs_main);
+            if (!fParentFailed) {
+                BlockMap::iterator mi = mapBlockIndex.find(hash);
+                fParentFailed = mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_FAILED_MASK);
+                if (!fParentFailed && !(mi->second->nStatus & BLOCK_HAVE_DATA))
+                    continue;
+            }
+
+            std::pair<std::multimap<uint256, uint256>::iterator, std::multimap<uint256, uint256>::iterator> range = mapBlocksWaitingByParent.equal_range(hash);
+            for (std::multimap<uint256, uint256>::iterator it = range.first; it != range.second; ++it) {
+                std::map<uint256, std::pair<NodeId, CBlock> >::iterator itBlock = mapBlocksWaitingForParent.find(it->second);
+                if (itBlock == mapBlocksWaitingForParent.end())
+                    continue;
+                if (fParentFailed) {
+                    queueParents.push_back(std::make_pair(it->second, true));
+                } else {
+                    mapBlockSource[it->second] = itBlock->second.first;
+                    vBlocks.push_back(itBlock->second.second);
+                }
+                nBlocksWaitingForParentSize -= ::GetSerializeSize(itBlock->second.second, SER_NETWORK, PROTOCOL_VERSION);
+                mapBlocksWaitingForParent.erase(itBlock);
+            }
+            mapBlocksWaitingByParent.erase(range.first, range.second);
+        }
+
+        for (CBlock& block : vBlocks) {
+            CValidationState state;
+            ProcessNewBlock(state, NULL, &block);
+            queueParents.push_back(std::make_pair(block.GetHash(), false));
+        }
+    }
+}
+
 bool TestBlockValidity(CValidationState& state, const CBlock& block, CBlockIndex* const pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     AssertLockHeld(cs_main);
@@ -5051,7 +5800,9 @@ bool static LoadBlockIndexDB(std::string& strError)
     for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // We can link the chain of blocks for which we've received transactions at some point.
+        // Pruned nodes may have deleted the block.
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -5090,6 +5841,11 @@ bool static LoadBlockIndexDB(std::string& strError)
         }
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     std::set<int> setBlkDataFiles;
@@ -5128,6 +5884,7 @@ bool static LoadBlockIndexDB(std::string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    nBlockCacheTipHeight = chainActive.Height();
 
     PruneBlockIndexCandidates();
 
@@ -5172,6 +5929,11 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -5189,7 +5951,7 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -5240,9 +6002,15 @@ void UnloadBlockIndex()
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    blockFileMaps.Clear();
+    blockCache.Clear();
+    nBlockCacheTipHeight = -1;
     nBlockSequenceId = 1;
     mapBlockSource.clear();
     mapBlocksInFlight.clear();
+    mapBlocksWaitingForParent.clear();
+    mapBlocksWaitingByParent.clear();
+    nBlocksWaitingForParentSize = 0;
     nQueuedValidatedHeaders = 0;
     nPreferredDownload = 0;
     setDirtyBlockIndex.clear();
@@ -5440,6 +6208,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -5447,6 +6216,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -5457,12 +6227,21 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
-        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
+        assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0)); // This is pruning-independent.
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                     // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -5474,11 +6253,20 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates.  chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
-        } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
+        } else { // If this block sorts worse than the current tip or some ancestor's block has never been seen, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
         }
         // Check whether this block is in mapBlocksUnlinked.
@@ -5492,12 +6280,28 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);          // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if:
+            //  - it has a descendant that at some point had more work than the
+            //    tip, and
+            //  - we tried switching to that descendant but were missing
+            //    data for some intermediate block between chainActive and the
+            //    tip.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -5517,6 +6321,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -5688,7 +6493,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end()) {
@@ -5713,7 +6518,13 @@ void static ProcessGetData(CNode* pfrom)
                         assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
                         pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    else if (inv.type == MSG_CMPCT_BLOCK) {
+                        // Older blocks are sent in full, the peer's mempool is unlikely to still have their transactions
+                        if ((nLocalServices & NODE_COMPACT_BLOCKS) && chainActive.Height() - mi->second->nHeight <= MAX_CMPCTBLOCK_DEPTH)
+                            pfrom->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block));
+                        else
+                            pfrom->PushMessage("block", block);
+                    } else // MSG_FILTERED_BLOCK)
                     {
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
@@ -5946,6 +6757,51 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+/** Whether a block is stored, or in the active chain; blocks known from their header only are not. Requires cs_main. */
+bool static HaveBlockData(const uint256& hash)
+{
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    return mi != mapBlockIndex.end() && ((mi->second->nStatus & BLOCK_HAVE_DATA) || chainActive.Contains(mi->second));
+}
+
+/** Whether both we and pfrom relay blocks as short transaction ids, see -compactblocks */
+bool static CompactBlocksEnabled(const CNode* pfrom)
+{
+    return (nLocalServices & NODE_COMPACT_BLOCKS) && (pfrom->nServices & NODE_COMPACT_BLOCKS);
+}
+
+/** Validate a block received whole or rebuilt from a compact block, whose parent we know */
+void static ProcessReceivedBlock(CNode* pfrom, CBlock& block, const std::string& strCommand)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    pfrom->AddInventoryKnown(inv);
+
+    bool fHaveData;
+    {
+        LOCK(cs_main);
+        fHaveData = HaveBlockData(inv.hash);
+    }
+
+    CValidationState state;
+    if (!fHaveData) {
+        ProcessNewBlock(state, pfrom, &block);
+        ProcessBlocksWaitingForParent(inv.hash);
+        int nDoS;
+        if(state.IsInvalid(nDoS)) {
+            pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
+                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+            if(nDoS > 0) {
+                TRY_LOCK(cs_main, lockMain);
+                if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
+            }
+        }
+        //disconnect this node if its old protocol version
+        pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+    } else {
+        LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, inv.hash.GetHex());
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -6170,6 +7026,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         std::vector<CInv> vToFetch;
 
+        // A single new block is asked for as a compact block, batches answering getblocks in full
+        unsigned int nBlockInvs = 0;
+        for (unsigned int nInv = 0; nInv < vInv.size(); nInv++)
+            if (vInv[nInv].type == MSG_BLOCK)
+                nBlockInvs++;
+        bool fFetchCompact = nBlockInvs == 1 && CompactBlocksEnabled(pfrom) && !IsInitialBlockDownload();
+        // During the initial download, announced blocks are fetched through their headers
+        bool fFetchHeaders = Params().HeadersFirstSyncingActive() && pfrom->nVersion >= HEADERS_FIRST_VERSION && IsInitialBlockDownload();
+
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
             const CInv& inv = vInv[nInv];
 
@@ -6186,9 +7051,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
-                    // Add this to the list of blocks to request
-                    vToFetch.push_back(inv);
-                    LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    if (fFetchHeaders) {
+                        // The block is downloaded along with the headers leading to it
+                        pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
+                        LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    } else {
+                        // Add this to the list of blocks to request
+                        vToFetch.push_back(fFetchCompact ? CInv(MSG_CMPCT_BLOCK, inv.hash) : inv);
+                        LogPrint("net", "getblocks (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    }
                 }
             }
 
@@ -6226,7 +7097,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
+    // Peers before HEADERS_FIRST_VERSION get an inventory for getheaders too
+    else if (strCommand == "getblocks" || (strCommand == "getheaders" && pfrom->nVersion < HEADERS_FIRST_VERSION)) {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -6258,7 +7130,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == "getheaders") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -6478,7 +7350,11 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
         }
+        CNodeState* nodestate = State(pfrom->GetId());
+        if (PruneHeadersWithoutData(nodestate->vHeadersWithoutData, true))
+            nodestate->nHeadersDataProgress = GetTime();
         CBlockIndex* pindexLast = NULL;
+        bool fCapped = false;
         for (const CBlockHeader& header : headers) {
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
@@ -6486,9 +7362,26 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 return error("non-continuous headers sequence");
             }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
+            // A proof-of-stake header carries no proof; what it claims is checked once its block
+            // is downloaded. Until then, at least keep it from running ahead of the clock, make it
+            // carry the difficulty it has to, and bound how many of them a peer can add.
+            if (header.GetBlockTime() > Params().MaxFutureBlockTime(GetAdjustedTime(), false))
+                return error("header %s timestamp too far in the future", header.GetHash().ToString());
+
+            bool fNew = !mapBlockIndex.count(header.GetHash());
+            if (fNew) {
+                if (nodestate->vHeadersWithoutData.size() >= MAX_HEADERS_WITHOUT_DATA) {
+                    fCapped = true;
+                    break;
+                }
+                BlockMap::iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+                if (mi != mapBlockIndex.end() && !CheckHeaderWork(header, mi->second)) {
+                    Misbehaving(pfrom->GetId(), 100);
+                    return error("header %s has incorrect difficulty", header.GetHash().ToString());
+                }
+            }
+
+            // Without transactions, AddToBlockIndex leaves the stake fields to AcceptBlock
             if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
@@ -6497,13 +7390,21 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                     std::string strError = "invalid header received " + header.GetHash().ToString();
                     return error(strError.c_str());
                 }
+            } else if (fNew && !HeaderResolved(pindexLast)) {
+                if (nodestate->vHeadersWithoutData.empty())
+                    nodestate->nHeadersDataProgress = GetTime();
+                nodestate->vHeadersWithoutData.push_back(pindexLast);
             }
         }
 
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (fCapped) {
+            // Asked again once their blocks caught up, see SendMessages
+            LogPrint("net", "peer=%d has %u headers without blocks, not accepting more for now\n", pfrom->id, nodestate->vHeadersWithoutData.size());
+            nodestate->fHeadersCapped = true;
+        } else if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
@@ -6534,24 +7435,157 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 pfrom->vBlockRequested.push_back(hashBlock);
             }
         } else {
-            pfrom->AddInventoryKnown(inv);
+            ProcessReceivedBlock(pfrom, block, strCommand);
+        }
+    }
 
-            CValidationState state;
-            if (!mapBlockIndex.count(block.GetHash())) {
-                ProcessNewBlock(state, pfrom, &block);
-                int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                                       state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        if (!CompactBlocksEnabled(pfrom)) {
+            LogPrint("net", "ignoring cmpctblock from peer=%d, compact blocks are not enabled on both sides\n", pfrom->id);
+            return true;
+        }
+
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        CInv inv(MSG_BLOCK, hashBlock);
+        LogPrint("net", "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+        pfrom->AddInventoryKnown(inv);
+
+        bool fHaveBlock, fHaveParent;
+        {
+            LOCK(cs_main);
+            UpdateBlockAvailability(pfrom->GetId(), hashBlock);
+            fHaveBlock = HaveBlockData(hashBlock);
+            BlockMap::iterator miPrev = mapBlockIndex.find(cmpctblock.header.hashPrevBlock);
+            fHaveParent = miPrev != mapBlockIndex.end();
+
+            // The header gets the checks of a headers message before the mempool is searched
+            // for its transactions
+            if (!fHaveBlock && fHaveParent) {
+                if (cmpctblock.header.GetBlockTime() > Params().MaxFutureBlockTime(GetAdjustedTime(), false))
+                    return error("%s : cmpctblock %s timestamp too far in the future", __func__, hashBlock.ToString());
+                if (!CheckHeaderWork(cmpctblock.header, miPrev->second)) {
+                    Misbehaving(pfrom->GetId(), 100);
+                    return error("%s : cmpctblock %s has incorrect difficulty", __func__, hashBlock.ToString());
                 }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(ActiveProtocol(), strCommand);
+                CValidationState state;
+                if (!CheckBlockHeader(cmpctblock.header, state, false) || !ContextualCheckBlockHeader(cmpctblock.header, state, miPrev->second)) {
+                    int nDoS;
+                    if (state.IsInvalid(nDoS) && nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    return error("%s : invalid cmpctblock header %s from peer=%d", __func__, hashBlock.ToString(), pfrom->id);
+                }
+            }
+        }
+
+        if (fHaveBlock) {
+            LogPrint("net", "%s : Already processed block %s, skipping cmpctblock\n", __func__, hashBlock.GetHex());
+        } else if (!fHaveParent) {
+            // The full block goes through the usual search for its missing ancestors
+            pfrom->PushMessage("getdata", std::vector<CInv>(1, inv));
+        } else {
+            std::shared_ptr<CPartiallyDownloadedBlock> partialBlock(new CPartiallyDownloadedBlock());
+            ReadStatus status = partialBlock->InitData(cmpctblock, mempool);
+            if (status == READ_STATUS_INVALID) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("%s : invalid cmpctblock %s from peer=%d", __func__, hashBlock.ToString(), pfrom->id);
+            }
+
+            std::vector<uint16_t> vMissing;
+            if (status == READ_STATUS_OK)
+                vMissing = partialBlock->GetMissing();
+
+            CBlock block;
+            if (status == READ_STATUS_OK && vMissing.empty())
+                status = partialBlock->FillBlock(block, std::vector<CTransaction>());
+
+            if (status != READ_STATUS_OK) {
+                // Short id collision; fall back to the full block
+                pfrom->PushMessage("getdata", std::vector<CInv>(1, inv));
+            } else if (vMissing.empty()) {
+                ProcessReceivedBlock(pfrom, block, strCommand);
             } else {
-                LogPrint("net", "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, block.GetHash().GetHex());
+                CBlockTransactionsRequest req;
+                req.blockhash = hashBlock;
+                req.vIndexes.swap(vMissing);
+                {
+                    LOCK(cs_main);
+                    CNodeState* nodestate = State(pfrom->GetId());
+                    nodestate->hashPartialBlock = hashBlock;
+                    nodestate->partialBlock = partialBlock;
+                }
+                LogPrint("net", "requesting %u transactions of cmpctblock %s from peer=%d\n", req.vIndexes.size(), hashBlock.ToString(), pfrom->id);
+                pfrom->PushMessage("getblocktxn", req);
+            }
+        }
+    }
+
+    else if (strCommand == "getblocktxn") {
+        if (!CompactBlocksEnabled(pfrom)) {
+            LogPrint("net", "ignoring getblocktxn from peer=%d, compact blocks are not enabled on both sides\n", pfrom->id);
+            return true;
+        }
+
+        CBlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "peer=%d asked for transactions of unknown block %s\n", pfrom->id, req.blockhash.ToString());
+        } else if (!chainActive.Contains(mi->second) || chainActive.Height() - mi->second->nHeight > MAX_CMPCTBLOCK_DEPTH) {
+            // Served, if at all, under the same rules as a getdata for the full block
+            pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+            ProcessGetData(pfrom);
+        } else {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, mi->second))
+                assert(!"cannot load block from disk");
+
+            CBlockTransactions resp(req);
+            for (size_t i = 0; i < req.vIndexes.size(); i++) {
+                if (req.vIndexes[i] >= block.vtx.size()) {
+                    Misbehaving(pfrom->GetId(), 100);
+                    return error("%s : peer=%d sent getblocktxn with out-of-bounds index", __func__, pfrom->id);
+                }
+                resp.vtx[i] = block.vtx[req.vIndexes[i]];
+            }
+            pfrom->PushMessage("blocktxn", resp);
+        }
+    }
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockTransactions resp;
+        vRecv >> resp;
+
+        std::shared_ptr<CPartiallyDownloadedBlock> partialBlock;
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (nodestate->hashPartialBlock == resp.blockhash) {
+                partialBlock.swap(nodestate->partialBlock);
+                nodestate->hashPartialBlock = uint256(0);
+            }
+        }
+
+        if (!partialBlock) {
+            LogPrint("net", "peer=%d sent blocktxn for block %s we did not ask for\n", pfrom->id, resp.blockhash.ToString());
+        } else {
+            CBlock block;
+            ReadStatus status = partialBlock->FillBlock(block, resp.vtx);
+            if (status == READ_STATUS_INVALID) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("%s : peer=%d sent a blocktxn that does not match its cmpctblock", __func__, pfrom->id);
+            } else if (status == READ_STATUS_FAILED) {
+                // Short id collision; fall back to the full block
+                pfrom->PushMessage("getdata", std::vector<CInv>(1, CInv(MSG_BLOCK, resp.blockhash)));
+            } else {
+                ProcessReceivedBlock(pfrom, block, strCommand);
             }
         }
     }
@@ -6859,6 +7893,63 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+/** Process a message, logging rather than passing on what it throws */
+bool static ProcessMessageCaught(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTime, unsigned int nMessageSize)
+{
+    bool fRet = false;
+    try {
+        fRet = ProcessMessage(pfrom, strCommand, vRecv, nTime);
+        boost::this_thread::interruption_point();
+    } catch (std::ios_base::failure& e) {
+        pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, std::string("error parsing message"));
+        if (strstr(e.what(), "end of data")) {
+            // Allow exceptions from under-length message on vRecv
+            LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", SanitizeString(strCommand), nMessageSize, e.what());
+        } else if (strstr(e.what(), "size too large")) {
+            // Allow exceptions from over-long size
+            LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught\n", SanitizeString(strCommand), nMessageSize, e.what());
+        } else {
+            PrintExceptionContinue(&e, "ProcessMessages()");
+        }
+    } catch (boost::thread_interrupted) {
+        throw;
+    } catch (std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessMessages()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessMessages()");
+    }
+
+    if (!fRet)
+        LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
+    return fRet;
+}
+
+/**
+ * Sync requests that can be processed by pmessageWorkers: they only read the masternode
+ * lists and take cs_main on their own when they penalize the peer. Pings, winners and
+ * votes read chainActive while holding the masternode and budget locks, which are
+ * taken after cs_main elsewhere, so they stay on the message handler thread.
+ */
+bool static IsAsyncMessage(const std::string& strCommand)
+{
+    static const std::set<std::string> setAsyncMessages = {"dseg", "mnget", "ssc"};
+    return setAsyncMessages.count(strCommand) > 0;
+}
+
+void static ProcessMessageAsync(CNode* pfrom, const std::string& strCommand, std::shared_ptr<CDataStream> pvRecv, int64_t nTime)
+{
+    ProcessMessageCaught(pfrom, strCommand, *pvRecv, nTime, pvRecv->size());
+    {
+        LOCK(pfrom->cs_vRecvMsg);
+        pfrom->fProcessingAsync = false;
+    }
+    {
+        LOCK(cs_vNodes);
+        pfrom->Release();
+    }
+    WakeMessageHandler();
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -6875,6 +7966,10 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
+    // Wait for the message being processed by the workers
+    if (pfrom->fProcessingAsync)
+        return fOk;
+
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom);
 
@@ -6931,33 +8026,23 @@ bool ProcessMessages(CNode* pfrom)
             continue;
         }
 
-        // Process message
-        bool fRet = false;
-        try {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
-            boost::this_thread::interruption_point();
-        } catch (std::ios_base::failure& e) {
-            pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, std::string("error parsing message"));
-            if (strstr(e.what(), "end of data")) {
-                // Allow exceptions from under-length message on vRecv
-                LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught, normally caused by a message being shorter than its stated length\n", SanitizeString(strCommand), nMessageSize, e.what());
-            } else if (strstr(e.what(), "size too large")) {
-                // Allow exceptions from over-long size
-                LogPrintf("ProcessMessages(%s, %u bytes): Exception '%s' caught\n", SanitizeString(strCommand), nMessageSize, e.what());
-            } else {
-                PrintExceptionContinue(&e, "ProcessMessages()");
+        // Messages that do not touch the chainstate are processed by the workers. The next
+        // message of this peer waits for it, which keeps the messages of a peer in order.
+        if (pmessageWorkers && pfrom->nVersion != 0 && IsAsyncMessage(strCommand)) {
+            pfrom->fProcessingAsync = true;
+            {
+                LOCK(cs_vNodes);
+                pfrom->AddRef();
             }
-        } catch (boost::thread_interrupted) {
-            throw;
-        } catch (std::exception& e) {
-            PrintExceptionContinue(&e, "ProcessMessages()");
-        } catch (...) {
-            PrintExceptionContinue(NULL, "ProcessMessages()");
+            // The payload is handed over rather than copied; the message is dropped below
+            std::shared_ptr<CDataStream> pvRecv = std::make_shared<CDataStream>(std::move(vRecv));
+            int64_t nTime = msg.nTime;
+            pmessageWorkers->Push([pfrom, strCommand, pvRecv, nTime] { ProcessMessageAsync(pfrom, strCommand, pvRecv, nTime); });
+            break;
         }
 
-        if (!fRet)
-            LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
-
+        // Process message
+        ProcessMessageCaught(pfrom, strCommand, vRecv, msg.nTime, nMessageSize);
         break;
     }
 
@@ -7075,10 +8160,15 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
-                pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                if (Params().HeadersFirstSyncingActive() && pto->nVersion >= HEADERS_FIRST_VERSION) {
+                    // Starting below our best header makes the peer send at least that one, so that
+                    // we learn which blocks it has and can download from it in parallel
+                    CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
+                } else {
+                    pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                }
             }
         }
 
@@ -7132,6 +8222,22 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!vInv.empty())
             pto->PushMessage("inv", vInv);
 
+        // Headers that claim more work than our tip, and whose blocks nobody delivers
+        if (PruneHeadersWithoutData(state.vHeadersWithoutData, false))
+            state.nHeadersDataProgress = GetTime();
+        if (!state.vHeadersWithoutData.empty() && state.nHeadersDataProgress < GetTime() - HEADERS_DATA_TIMEOUT) {
+            LogPrintf("Peer=%d announced %u headers whose blocks did not arrive\n", pto->id, state.vHeadersWithoutData.size());
+            state.vHeadersWithoutData.clear();
+            Misbehaving(pto->GetId(), 50);
+            ResetBestHeader();
+        }
+        if (state.fHeadersCapped && state.vHeadersWithoutData.size() < MAX_HEADERS_WITHOUT_DATA / 2) {
+            state.fHeadersCapped = false;
+            CBlockIndex* pindexStart = state.pindexBestKnownBlock ? state.pindexBestKnownBlock : pindexBestHeader;
+            LogPrint("net", "resume getheaders (%d) to peer=%d\n", pindexStart->nHeight, pto->id);
+            pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
+        }
+
         // Detect whether we're stalling
         int64_t nNow = GetTimeMicros();
         if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -7198,6 +8304,25 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
 
 bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 {
+    if (pblockWriter) {
+        // The undo data and its checksum go right after the index header at the position reserved for them
+        CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+        unsigned int nSize = ssUndo.GetSerializeSize(*this);
+        ssUndo << FLATDATA(Params().MessageStart()) << nSize;
+        unsigned int nHeaderSize = ssUndo.size();
+        ssUndo << *this;
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << hashBlock;
+        hasher << *this;
+        ssUndo << hasher.GetHash();
+        std::vector<char> vData(ssUndo.begin(), ssUndo.end());
+        CDiskBlockPos posHeader = pos;
+        pos.nPos += nHeaderSize;
+        if (!pblockWriter->Write(posHeader, true, vData))
+            return error("CBlockUndo::WriteToDisk : block file writer failed");
+        return true;
+    }
+
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
@@ -7225,16 +8350,25 @@ bool CBlockUndo::WriteToDisk(CDiskBlockPos& pos, const uint256& hashBlock)
 
 bool CBlockUndo::ReadFromDisk(const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
-
-    // Read block
+    // Read block, from memory if it is still queued to be written
     uint256 hashChecksum;
     try {
-        filein >> *this;
-        filein >> hashChecksum;
+        unsigned int nOffset;
+        std::shared_ptr<const std::vector<char> > pending;
+        if (pblockWriter)
+            pending = pblockWriter->GetPending(pos, true, nOffset);
+        if (pending) {
+            CSpanReader filein((const unsigned char*)pending->data() + nOffset, (const unsigned char*)pending->data() + pending->size(), SER_DISK, CLIENT_VERSION);
+            filein >> *this;
+            filein >> hashChecksum;
+        } else {
+            // Open history file to read
+            CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("CBlockUndo::ReadFromDisk : OpenBlockFile failed");
+            filein >> *this;
+            filein >> hashChecksum;
+        }
     } catch (std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
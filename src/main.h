@@ -34,8 +34,10 @@
 #include "undo.h"
 
 #include <algorithm>
+#include <deque>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -47,13 +49,20 @@
 
 #include <boost/unordered_map.hpp>
 
+class CBlockFileWriter;
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsRunningStats;
+class CCoinsViewDB;
+class CCoinsViewAsyncWriter;
+class CMessageWorkers;
+class CMappedFile;
 class CZerocoinDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
@@ -99,10 +108,16 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
+static const unsigned int MIN_BLOCKS_TO_KEEP = 2880;
+/** Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat) */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -maxzcspendcachesize, maximum number of verified zerocoin spends kept in memory */
+static const int64_t DEFAULT_MAX_ZC_SPEND_CACHE_SIZE = 10000;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -110,6 +125,13 @@ static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached their tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Number of headers a peer may have announced, ahead of our tip, whose blocks we do not have yet.
+ *  Proof-of-stake headers carry no proof, so this is what bounds the headers a peer can make up. */
+static const unsigned int MAX_HEADERS_WITHOUT_DATA = 2 * MAX_HEADERS_RESULTS;
+/** Time in seconds the headers a peer announced may go without any of their blocks arriving. */
+static const int64_t HEADERS_DATA_TIMEOUT = 20 * 60;
+/** Serialized size of the downloaded blocks that may wait for the data of their parent. */
+static const size_t MAX_BLOCKS_WAITING_FOR_PARENT_SIZE = 32 * 1000 * 1000;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
@@ -123,6 +145,8 @@ static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Enable bloom filter */
  static const bool DEFAULT_PEERBLOOMFILTERS = true;
 static const bool DEFAULT_PEERBLOOMFILTERS_ZC = false;
+/** Default for -compactblocks, announce and accept blocks as short transaction ids */
+static const bool DEFAULT_COMPACT_BLOCKS = true;
 
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
@@ -171,7 +195,14 @@ extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
-extern unsigned int nCoinCacheSize;
+extern bool fBlockMmap;
+/** True if any block files have ever been pruned. */
+extern bool fHavePruned;
+/** True if we're running in -prune mode. */
+extern bool fPruneMode;
+/** Number of MiB of block files that we're trying to stay below. */
+extern uint64_t nPruneTarget;
+extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern int64_t nMaxTipAge;
@@ -215,10 +246,17 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
  * @return True if state.IsValid()
  */
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp = NULL);
+/** Keep a requested block until the data of its parent arrives, unless the queue is full (requires cs_main) */
+bool AddBlockWaitingForParent(NodeId nodeid, const CBlock& block);
+/** Forget the headers that got their blocks or fell behind our tip, only the oldest ones unless fAll;
+ *  returns whether any were forgotten (requires cs_main) */
+bool PruneHeadersWithoutData(std::deque<CBlockIndex*>& vHeaders, bool fAll);
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const CDiskBlockPos& pos, bool fReadOnly = false);
+/** Memory map of a block file that is no longer appended to, or NULL if it isn't finalized or -blockmmap is off */
+std::shared_ptr<const CMappedFile> MapFinalizedBlockFile(int nFile);
 /** Open an undo file (rev?????.dat) */
 FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
@@ -244,6 +282,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the zerocoin spend proof checking thread */
+void ThreadZerocoinSpendCheck();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -273,6 +313,14 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Prune block files and flush state to disk. */
+void PruneAndFlush();
+/** Calculate the amount of disk space the block & undo files currently use */
+uint64_t CalculateCurrentUsage();
+/** Mark one block file as pruned: its blocks lose their data and undo positions */
+void PruneOneBlockFile(const int fileNumber);
+/** Actually unlink the specified files */
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 
 
 /** (try to) add transaction to memory pool **/
@@ -370,9 +418,13 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack = false);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack = false, std::vector<CZerocoinSpendCheck>* pvSpendChecks = NULL);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack = false);
+/**
+ * Check the zerocoin spends of a transaction. If pvSpendChecks is not NULL, the (expensive) spend
+ * proof verifications are pushed onto it instead of being performed inline.
+ */
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack = false, std::vector<CZerocoinSpendCheck>* pvSpendChecks = NULL);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend* spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend* spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx);
@@ -460,11 +512,41 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the proof verification of one private zerocoin spend
+ * against the accumulator value it claims to be a member of
+ */
+class CZerocoinSpendCheck
+{
+private:
+    libzerocoin::CoinSpend spend;
+    const libzerocoin::ZerocoinParams* params;
+    CBigNum bnAccumulatorValue;
+    bool fVerifyParams;
+
+public:
+    CZerocoinSpendCheck() : params(NULL), fVerifyParams(true) {}
+    CZerocoinSpendCheck(const libzerocoin::CoinSpend& spendIn, const libzerocoin::ZerocoinParams* paramsIn, const CBigNum& bnAccumulatorValueIn, bool fVerifyParamsIn) : spend(spendIn),
+                                                                                                                                                                       params(paramsIn), bnAccumulatorValue(bnAccumulatorValueIn), fVerifyParams(fVerifyParamsIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        std::swap(spend, check.spend);
+        std::swap(params, check.params);
+        std::swap(bnAccumulatorValue, check.bnAccumulatorValue);
+        std::swap(fVerifyParams, check.fVerifyParams);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read a block through the decoded block cache; NULL on failure. The block is shared and must not be modified. */
+std::shared_ptr<const CBlock> ReadBlockShared(const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -472,14 +554,16 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. If pstats is provided, the
+ *  change to the UTXO set statistics is added to it. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, CCoinsRunningStats* pstats = NULL);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
 
-/** Apply the effects of this block (with given index) on the UTXO set represented by coins */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false);
+/** Apply the effects of this block (with given index) on the UTXO set represented by coins.
+ *  If pstats is provided, the change to the UTXO set statistics is added to it. */
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false, CCoinsRunningStats* pstats = NULL);
 
 /** Verify defee */
 bool IsDevFeeValid(const CBlock& block, int nBlockHeight);
@@ -488,6 +572,8 @@ bool IsDevFeeValid(const CBlock& block, int nBlockHeight);
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
+/** CheckWork for a header, whose block is not known to be proof-of-work or proof-of-stake yet */
+bool CheckHeaderWork(const CBlockHeader& header, const CBlockIndex* pindexPrev);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
@@ -656,6 +742,24 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Global variable that points to the chainstate database below pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB* pcoinsdbview;
+
+/** Start keeping the UTXO set statistics of the tip up to date from stats, persisting them in pdb (NULL to stop) */
+void InitCoinsStats(CCoinsViewDB* pdb, const CCoinsRunningStats& stats);
+
+/** The UTXO set statistics of the tip, false if they are not kept */
+bool GetTipCoinsStats(CCoinsStats& stats);
+
+/** The view below pcoinsTip that writes flushed coins in the background, if enabled (protected by cs_main) */
+extern CCoinsViewAsyncWriter* pcoinsWriter;
+
+/** Writes blocks and undo data to their files in the background, if enabled */
+extern CBlockFileWriter* pblockWriter;
+
+/** Processes the peer messages that do not touch the chainstate, if enabled */
+extern CMessageWorkers* pmessageWorkers;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
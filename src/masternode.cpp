@@ -16,10 +16,13 @@
 std::map<uint256, int> mapSeenMasternodeScanningErrors;
 // cache block hashes as we calculate them
 std::map<int64_t, uint256> mapCacheBlockHashes;
+// messages using the cache are processed by several threads
+static CCriticalSection cs_mapCacheBlockHashes;
 
 //Get the last hash that matches the modulus given. Processed in reverse order
 bool GetBlockHash(uint256& hash, int nBlockHeight)
 {
+    LOCK(cs_mapCacheBlockHashes);
     if (chainActive.Tip() == NULL) return false;
 
     if (nBlockHeight == 0)
@@ -792,9 +795,18 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fChec
         	if (!VerifySignature(pmn->pubKeyMasternode, nDos))
                 return false;
 
-            BlockMap::iterator mi = mapBlockIndex.find(blockHash);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                if ((*mi).second->nHeight < chainActive.Height() - 24) {
+            // Pings are processed outside the message handler thread, which changes the block index
+            int nPingBlockHeight = -1;
+            int nTipHeight;
+            {
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(blockHash);
+                if (mi != mapBlockIndex.end() && (*mi).second)
+                    nPingBlockHeight = (*mi).second->nHeight;
+                nTipHeight = chainActive.Height();
+            }
+            if (nPingBlockHeight >= 0) {
+                if (nPingBlockHeight < nTipHeight - 24) {
                     LogPrint("masternode","CMasternodePing::CheckAndUpdate - Masternode %s block hash %s is too old\n", vin.prevout.hash.ToString(), blockHash.ToString());
                     // Do nothing here (no Masternode update, no mnping relay)
                     // Let this node to be visible but fail to accept mnping
@@ -0,0 +1,51 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "messageworkers.h"
+
+#include "util.h"
+
+CMessageWorkers::CMessageWorkers(int nThreads) : fStop(false)
+{
+    for (int i = 0; i < nThreads; i++)
+        vThreads.push_back(std::thread([this] { TraceThread("msgwork", [this] { ThreadWork(); }); }));
+}
+
+CMessageWorkers::~CMessageWorkers()
+{
+    {
+        WaitableLock lock(cs);
+        fStop = true;
+        queueJobs.clear();
+    }
+    cond.notify_all();
+    for (std::thread& thread : vThreads)
+        thread.join();
+}
+
+void CMessageWorkers::Push(const std::function<void()>& job)
+{
+    {
+        WaitableLock lock(cs);
+        queueJobs.push_back(job);
+    }
+    cond.notify_one();
+}
+
+void CMessageWorkers::ThreadWork()
+{
+    WaitableLock lock(cs);
+    while (true) {
+        while (queueJobs.empty() && !fStop)
+            cond.wait(lock);
+        if (fStop)
+            return;
+
+        std::function<void()> job = queueJobs.front();
+        queueJobs.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MESSAGEWORKERS_H
+#define BITCOIN_MESSAGEWORKERS_H
+
+#include "sync.h"
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+//! -msgthreads default
+static const int DEFAULT_MESSAGE_THREADS = 2;
+//! Maximum number of message processing threads
+static const int MAX_MESSAGE_THREADS = 16;
+
+/**
+ * Threads that process peer messages which do not touch the chainstate, such
+ * as the masternode, budget and payment messages, so that they do not wait
+ * behind block processing in ThreadMessageHandler. Jobs run in the order they
+ * were queued, but jobs of different peers run concurrently; the caller keeps
+ * the messages of one peer in order by queueing at most one of them at a time.
+ */
+class CMessageWorkers
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::deque<std::function<void()> > queueJobs;
+    bool fStop;
+    std::vector<std::thread> vThreads;
+
+    void ThreadWork();
+
+public:
+    CMessageWorkers(int nThreads);
+    //! Waits for the jobs being run; jobs still queued are dropped
+    ~CMessageWorkers();
+
+    void Push(const std::function<void()>& job);
+};
+
+#endif // BITCOIN_MESSAGEWORKERS_H
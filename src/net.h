@@ -65,8 +65,21 @@ static const bool DEFAULT_UPNP = false;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 
+/** How the socket handler thread waits for sockets to become ready */
+enum SocketEventsMode {
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_EPOLL,
+};
+#ifdef HAVE_SYS_EPOLL_H
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
+//! Wake ThreadMessageHandler, e.g. when a node can process its next message
+void WakeMessageHandler();
 
 void AddOneShot(std::string strDest);
 bool RecvLine(SOCKET hSocket, std::string& strLine);
@@ -83,6 +96,8 @@ bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode* pnode);
+/** Parse a -socketevents value; false if it is unknown or not supported on this platform */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode);
 
 typedef int NodeId;
 
@@ -131,6 +146,7 @@ extern uint64_t nLocalServices;
 extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 extern int nMaxConnections;
+extern SocketEventsMode nSocketEventsMode;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
@@ -295,10 +311,17 @@ public:
     uint64_t nSendBytes;
     std::deque<CSerializeData> vSendMsg;
     CCriticalSection cs_vSend;
+    //! Whether the socket is registered with epoll, and the readiness it reported that is
+    //! not used up yet; only used by the socket handler thread
+    bool fSocketRegistered;
+    bool fRecvReady;
+    bool fSendReady;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    //! A message of this node is being processed by pmessageWorkers; the next one waits for it (protected by cs_vRecvMsg)
+    bool fProcessingAsync;
     uint64_t nRecvBytes;
     int nRecvVersion;
 
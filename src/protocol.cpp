@@ -38,7 +38,8 @@ static const char* ppszTypeName[] =
         "dstx",
         "pubcoins",
         "genwit",
-        "accvalue"
+        "accvalue",
+        "compact block"
     };
 
 CMessageHeader::CMessageHeader()
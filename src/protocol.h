@@ -86,6 +86,11 @@ enum {
     // support for the light zerocoin protocol.
     NODE_BLOOM_LIGHT_ZC = (1 << 5),
 
+    // NODE_COMPACT_BLOCKS means the node announces new blocks as short transaction ids
+    // (cmpctblock) and rebuilds announced blocks from its mempool, asking for the
+    // missing transactions with getblocktxn.
+    NODE_COMPACT_BLOCKS = (1 << 6),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
@@ -179,7 +184,9 @@ enum {
     MSG_DSTX,
     MSG_PUBCOINS,
     MSG_GENWIT,
-    MSG_ACC_VALUE
+    MSG_ACC_VALUE,
+    // Only used in getdata, to ask for a block as a cmpctblock message
+    MSG_CMPCT_BLOCK
 };
 
 #endif // BITCOIN_PROTOCOL_H
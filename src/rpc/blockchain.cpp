@@ -144,7 +144,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 
     UniValue zNZRObj(UniValue::VOBJ);
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zNZRObj.push_back(Pair(std::to_string(denom), ValueFromAmount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zNZRObj.push_back(Pair(std::to_string(denom), ValueFromAmount(blockindex->zerocoinSupply.at(denom) * (denom*COIN))));
     }
     zNZRObj.push_back(Pair("total", ValueFromAmount(blockindex->GetZerocoinSupply())));
     result.push_back(Pair("zNZRsupply", zNZRObj));
@@ -640,20 +640,23 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if (!ReadBlockFromDisk(block, pblockindex))
+    if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    std::shared_ptr<const CBlock> pblock = ReadBlockShared(pblockindex);
+    if (!pblock)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
+        ssBlock << *pblock;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex);
+    return blockToJSON(*pblock, pblockindex);
 }
 
 UniValue getblockheader(const UniValue& params, bool fHelp)
@@ -714,7 +717,8 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
         throw std::runtime_error(
             "gettxoutsetinfo\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The statistics are kept up to date as blocks are connected; hash_serialized is a\n"
+            "MuHash of the set that does not depend on the database layout.\n"
 
             "\nResult:\n"
             "{\n"
@@ -735,8 +739,7 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
+    if (GetTipCoinsStats(stats)) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
@@ -748,6 +751,81 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static UniValue DBStatsToJSON(const CLevelDBStats& stats)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", stats.strPath));
+    ret.push_back(Pair("cache", (uint64_t)stats.tuning.nCacheSize));
+    ret.push_back(Pair("writebuffer", (uint64_t)stats.tuning.nWriteBufferSize));
+    ret.push_back(Pair("bloombits", stats.tuning.nBloomBits));
+    ret.push_back(Pair("compression", stats.tuning.fCompression));
+    ret.push_back(Pair("maxopenfiles", stats.tuning.nMaxOpenFiles));
+    ret.push_back(Pair("reads", stats.nReads));
+    ret.push_back(Pair("readbytes", stats.nReadBytes));
+    ret.push_back(Pair("writes", stats.nWrites));
+    ret.push_back(Pair("writebytes", stats.nWriteBytes));
+    ret.push_back(Pair("syncs", stats.nSyncs));
+    ret.push_back(Pair("memoryusage", stats.nMemoryUsage));
+    UniValue files(UniValue::VARR);
+    for (int nFiles : stats.vFilesAtLevel)
+        files.push_back(nFiles);
+    ret.push_back(Pair("filesatlevel", files));
+    ret.push_back(Pair("compactionstats", stats.strCompactionStats));
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getdbstats\n"
+            "\nReturns the options, usage counters and LevelDB statistics of the block index,\n"
+            "chainstate and zerocoin databases. The counters start at zero when the database is opened.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"blockindex\": {             (object) statistics of the block index database\n"
+            "    \"path\": \"...\",             (string) database directory\n"
+            "    \"cache\": n,                (numeric) cache size in bytes, half of it is the block cache\n"
+            "    \"writebuffer\": n,          (numeric) memtable size in bytes\n"
+            "    \"bloombits\": n,            (numeric) bloom filter bits per key, 0 if none\n"
+            "    \"compression\": true|false, (boolean) whether table blocks are compressed\n"
+            "    \"maxopenfiles\": n,         (numeric) maximum number of open table files\n"
+            "    \"reads\": n,                (numeric) number of point reads\n"
+            "    \"readbytes\": n,            (numeric) bytes of keys and values found by point reads\n"
+            "    \"writes\": n,               (numeric) number of batches written\n"
+            "    \"writebytes\": n,           (numeric) bytes of keys and values written\n"
+            "    \"syncs\": n,                (numeric) number of batches written with fsync\n"
+            "    \"memoryusage\": n,          (numeric) approximate memory used by memtables and block cache\n"
+            "    \"filesatlevel\": [n,...],   (array) number of table files at each level\n"
+            "    \"compactionstats\": \"...\"   (string) LevelDB compaction statistics per level\n"
+            "  },\n"
+            "  \"chainstate\": { ... },      (object) statistics of the chainstate database\n"
+            "  \"zerocoin\": { ... }         (object) statistics of the zerocoin database\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getdbstats", "") + HelpExampleRpc("getdbstats", ""));
+
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VOBJ);
+    CLevelDBStats stats;
+    if (pblocktree) {
+        pblocktree->GetStats(stats);
+        ret.push_back(Pair("blockindex", DBStatsToJSON(stats)));
+    }
+    if (pcoinsdbview) {
+        pcoinsdbview->GetDBStats(stats);
+        ret.push_back(Pair("chainstate", DBStatsToJSON(stats)));
+    }
+    if (zerocoinDB) {
+        zerocoinDB->GetStats(stats);
+        ret.push_back(Pair("zerocoin", DBStatsToJSON(stats)));
+    }
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -903,6 +981,8 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest height from which all blocks up to the tip are stored (only present if pruning is enabled)\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -931,7 +1011,15 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
     CBlockIndex* tip = chainActive.Tip();
+    if (fPruneMode) {
+        CBlockIndex* block = tip;
+        while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+            block = block->pprev;
+
+        obj.push_back(Pair("pruneheight", block->nHeight));
+    }
     UniValue softforks(UniValue::VARR);
     softforks.push_back(SoftForkDesc("bip65", 5, tip));
     obj.push_back(Pair("softforks",             softforks));
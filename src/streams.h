@@ -414,6 +414,64 @@ public:
     }
 };
 
+/** Read-only stream over a byte range owned by someone else, such as a memory
+ *  mapped file. Objects are unserialized straight from the range, without a
+ *  copy into an intermediate buffer. The range must outlive the reader.
+ */
+class CSpanReader
+{
+private:
+    int nType;
+    int nVersion;
+
+    const char* pcur;
+    const char* pend;
+
+public:
+    CSpanReader(const unsigned char* pbegin, const unsigned char* pendIn, int nTypeIn, int nVersionIn)
+    {
+        pcur = (const char*)pbegin;
+        pend = (const char*)pendIn;
+        nType = nTypeIn;
+        nVersion = nVersionIn;
+    }
+
+    //
+    // Stream subset
+    //
+    size_t size() const { return pend - pcur; }
+    bool empty() const { return pcur == pend; }
+    void SetType(int n) { nType = n; }
+    int GetType() { return nType; }
+    void SetVersion(int n) { nVersion = n; }
+    int GetVersion() { return nVersion; }
+
+    CSpanReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CSpanReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore : end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper around a FILE* that implements a ring buffer to
  *  deserialize from. It guarantees the ability to rewind a given number of bytes.
  *
@@ -0,0 +1,135 @@
+// Copyright (c) 2019 The NodeZero developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+#include "main.h"
+#include "streams.h"
+#include "txmempool.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+static CBlock BuildBlockTestCase()
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    block.vtx.resize(4);
+    block.vtx[0] = tx;
+    block.nVersion = 42;
+    block.hashPrevBlock = GetRandHash();
+    block.nBits = 0x207fffff;
+
+    for (int i = 1; i < 4; i++) {
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vin[0].prevout.n = 0;
+        block.vtx[i] = tx;
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(cmpctblock_roundtrip)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlockTestCase());
+
+    // The peer has all but the third transaction
+    pool.addUnchecked(block.vtx[1].GetHash(), CTxMemPoolEntry(block.vtx[1], 0, 0, 0, 0));
+    pool.addUnchecked(block.vtx[3].GetHash(), CTxMemPoolEntry(block.vtx[3], 0, 0, 0, 0));
+
+    CBlockHeaderAndShortTxIDs cmpctblock(block);
+    BOOST_CHECK_EQUAL(cmpctblock.vPrefilledTxn.size(), 1);
+    BOOST_CHECK_EQUAL(cmpctblock.vShortTxIds.size(), 3);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblock2;
+    stream >> cmpctblock2;
+    BOOST_CHECK(cmpctblock2.header.GetHash() == block.GetHash());
+    BOOST_CHECK(cmpctblock2.vShortTxIds == cmpctblock.vShortTxIds);
+    BOOST_CHECK_EQUAL(cmpctblock2.GetShortID(block.vtx[2].GetHash()), cmpctblock.GetShortID(block.vtx[2].GetHash()));
+
+    CPartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock2, pool) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(2));
+    BOOST_CHECK(partialBlock.IsTxAvailable(3));
+
+    std::vector<uint16_t> vMissing = partialBlock.GetMissing();
+    BOOST_CHECK_EQUAL(vMissing.size(), 1);
+    BOOST_CHECK_EQUAL(vMissing[0], 2);
+
+    // A wrong transaction gives a wrong merkle root
+    CPartiallyDownloadedBlock partialBlockCopy = partialBlock;
+    CBlock block2;
+    BOOST_CHECK(partialBlockCopy.FillBlock(block2, std::vector<CTransaction>(1, block.vtx[1])) == READ_STATUS_FAILED);
+
+    CBlock block3;
+    BOOST_CHECK(partialBlock.FillBlock(block3, std::vector<CTransaction>(1, block.vtx[2])) == READ_STATUS_OK);
+    BOOST_CHECK(block3.GetHash() == block.GetHash());
+    BOOST_CHECK(block3.BuildMerkleTree() == block.hashMerkleRoot);
+}
+
+BOOST_AUTO_TEST_CASE(cmpctblock_proof_of_stake)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block(BuildBlockTestCase());
+    CMutableTransaction coinstake(block.vtx[1]);
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    block.vtx[1] = coinstake;
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    block.vchBlockSig = std::vector<unsigned char>(72, 0x42);
+    BOOST_CHECK(block.IsProofOfStake());
+
+    // Both the coinbase and the coinstake are sent along
+    pool.addUnchecked(block.vtx[2].GetHash(), CTxMemPoolEntry(block.vtx[2], 0, 0, 0, 0));
+    pool.addUnchecked(block.vtx[3].GetHash(), CTxMemPoolEntry(block.vtx[3], 0, 0, 0, 0));
+    CBlockHeaderAndShortTxIDs cmpctblock(block);
+    BOOST_CHECK_EQUAL(cmpctblock.vPrefilledTxn.size(), 2);
+    BOOST_CHECK_EQUAL(cmpctblock.vShortTxIds.size(), 2);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblock2;
+    stream >> cmpctblock2;
+
+    CPartiallyDownloadedBlock partialBlock;
+    BOOST_CHECK(partialBlock.InitData(cmpctblock2, pool) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.GetMissing().empty());
+
+    // The block signature survives the rebuild
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, std::vector<CTransaction>()) == READ_STATUS_OK);
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+    BOOST_CHECK(block2.IsProofOfStake());
+    BOOST_CHECK(block2.vtx[1].GetHash() == block.vtx[1].GetHash());
+    BOOST_CHECK(block2.vchBlockSig == block.vchBlockSig);
+}
+
+BOOST_AUTO_TEST_CASE(blocktxn_request_roundtrip)
+{
+    CBlockTransactionsRequest req;
+    req.blockhash = GetRandHash();
+    req.vIndexes.push_back(0);
+    req.vIndexes.push_back(1);
+    req.vIndexes.push_back(3);
+    req.vIndexes.push_back(4000);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    CBlockTransactionsRequest req2;
+    stream >> req2;
+    BOOST_CHECK(req2.blockhash == req.blockhash);
+    BOOST_CHECK(req2.vIndexes == req.vIndexes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "coinstats.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "test/test_nodezero.h"
 
@@ -176,4 +178,194 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Entries of a CCoinsMap must stay in place while the table grows, and
+// erasing while iterating must visit every entry exactly once.
+BOOST_AUTO_TEST_CASE(coins_map_test)
+{
+    CCoinsMap map;
+    std::map<uint256, CCoinsCacheEntry*> result;
+    for (int i = 0; i < 1000; i++) {
+        uint256 txid = GetRandHash();
+        std::pair<CCoinsMap::iterator, bool> ret = map.insert(std::make_pair(txid, CCoinsCacheEntry()));
+        BOOST_CHECK(ret.second);
+        ret.first->second.coins.nHeight = i;
+        result[txid] = &ret.first->second;
+    }
+    BOOST_CHECK_EQUAL(map.size(), result.size());
+    BOOST_CHECK(map.DynamicMemoryUsage() >= result.size() * sizeof(CCoinsMap::value_type));
+
+    for (std::map<uint256, CCoinsCacheEntry*>::iterator it = result.begin(); it != result.end(); it++) {
+        CCoinsMap::iterator itMap = map.find(it->first);
+        BOOST_CHECK(itMap != map.end());
+        BOOST_CHECK(&itMap->second == it->second);
+        BOOST_CHECK(!map.insert(std::make_pair(it->first, CCoinsCacheEntry())).second);
+    }
+    BOOST_CHECK(map.find(GetRandHash()) == map.end());
+
+    // Erase every other entry, then drain the rest the way BatchWrite does
+    int n = 0;
+    for (std::map<uint256, CCoinsCacheEntry*>::iterator it = result.begin(); it != result.end(); n++) {
+        if (n % 2) {
+            map.erase(map.find(it->first));
+            result.erase(it++);
+        } else {
+            it++;
+        }
+    }
+    for (CCoinsMap::iterator it = map.begin(); it != map.end();) {
+        BOOST_CHECK(result.erase(it->first) == 1);
+        CCoinsMap::iterator itOld = it++;
+        map.erase(itOld);
+    }
+    BOOST_CHECK(result.empty());
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+}
+
+//! A coin database, empty at the start of each test
+struct CoinsDBTestingSetup : public TestingSetup {
+    CCoinsViewDB db;
+
+    CoinsDBTestingSetup() : db(1 << 20, true) {}
+};
+
+//! Write mapCoins to view through a cache, with hashBlock as its best block
+static void WriteCoins(CCoinsView* view, const std::map<uint256, CCoins>& mapCoins, const uint256& hashBlock)
+{
+    CCoinsViewCache cache(view);
+    for (std::map<uint256, CCoins>::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
+        *cache.ModifyCoins(it->first) = it->second;
+    cache.SetBestBlock(hashBlock);
+    BOOST_CHECK(cache.Flush());
+}
+
+//! Write the unspent outputs of nTxs random transactions to view, add them to mapCoins,
+//! and return the best block they were written with
+static uint256 PopulateCoins(CCoinsView* view, int nTxs, std::map<uint256, CCoins>& mapCoins)
+{
+    std::map<uint256, CCoins> mapNew;
+    for (int i = 0; i < nTxs; i++) {
+        CCoins& coins = mapNew[GetRandHash()];
+        coins.nVersion = 1;
+        coins.nHeight = 1 + insecure_rand() % 1000;
+        coins.fCoinBase = insecure_rand() % 5 == 0;
+        coins.vout.resize(1 + insecure_rand() % 4);
+        for (unsigned int n = 0; n < coins.vout.size(); n++) {
+            coins.vout[n].nValue = insecure_rand() % 100000;
+            coins.vout[n].scriptPubKey = CScript() << n;
+        }
+    }
+    uint256 hashBlock = GetRandHash();
+    WriteCoins(view, mapNew, hashBlock);
+    mapCoins.insert(mapNew.begin(), mapNew.end());
+    return hashBlock;
+}
+
+// The coin database stores unspent outputs separately; spending some of them
+// through a cache must leave exactly the others behind.
+BOOST_FIXTURE_TEST_CASE(coins_db_per_output_test, CoinsDBTestingSetup)
+{
+    uint256 txid = GetRandHash();
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = 100;
+    coins.fCoinStake = true;
+    coins.vout.resize(70);
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        coins.vout[i].nValue = i + 1;
+    WriteCoins(&db, std::map<uint256, CCoins>{{txid, coins}}, GetRandHash());
+    CCoins read;
+    BOOST_CHECK(db.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+
+    // Spend outputs on both sides of the first 64, including the last one
+    const int spent[] = {0, 5, 66, 69};
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            for (unsigned int i = 0; i < sizeof(spent) / sizeof(spent[0]); i++) {
+                BOOST_CHECK(modifier->Spend(spent[i]));
+                coins.Spend(spent[i]);
+            }
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetCoins(txid, read));
+    BOOST_CHECK(read == coins);
+    BOOST_CHECK(!read.IsAvailable(66) && read.IsAvailable(67));
+
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(txid)->Clear();
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK(!db.GetCoins(txid, read));
+}
+
+// Coins flushed into a CCoinsViewAsyncWriter must be readable through it
+// while they are written, and be in the database once it synced.
+BOOST_FIXTURE_TEST_CASE(coins_async_writer_test, CoinsDBTestingSetup)
+{
+    CCoinsViewAsyncWriter writer(&db);
+    std::map<uint256, CCoins> result;
+    uint256 hashBlock;
+    for (int nFlush = 0; nFlush < 4; nFlush++) {
+        hashBlock = PopulateCoins(&writer, 100, result);
+        BOOST_CHECK(writer.GetBestBlock() == hashBlock);
+        for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+            CCoins coins;
+            BOOST_CHECK(writer.GetCoins(it->first, coins));
+            BOOST_CHECK(coins == it->second);
+        }
+    }
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+        CCoins coins;
+        BOOST_CHECK(db.GetCoins(it->first, coins));
+        BOOST_CHECK(coins == it->second);
+    }
+}
+
+// The running statistics must not depend on the order outputs are added and
+// removed in, and must match the statistics computed from the database.
+BOOST_FIXTURE_TEST_CASE(coins_running_stats_test, CoinsDBTestingSetup)
+{
+    std::map<uint256, CCoins> txs;
+    PopulateCoins(&db, 20, txs);
+
+    CCoinsRunningStats running, reversed;
+    for (std::map<uint256, CCoins>::const_iterator it = txs.begin(); it != txs.end(); it++) {
+        running.nTransactions++;
+        for (unsigned int n = 0; n < it->second.vout.size(); n++)
+            running.AddOutput(COutPoint(it->first, n), it->second, it->second.vout[n]);
+    }
+    for (std::map<uint256, CCoins>::const_reverse_iterator it = txs.rbegin(); it != txs.rend(); it++) {
+        for (unsigned int n = it->second.vout.size(); n-- > 0;)
+            reversed.AddOutput(COutPoint(it->first, n), it->second, it->second.vout[n]);
+    }
+    BOOST_CHECK(running.hash.Finalize() == reversed.hash.Finalize());
+
+    CCoinsRunningStats computed;
+    BOOST_CHECK(db.ComputeRunningStats(computed));
+    BOOST_CHECK_EQUAL(computed.nTransactions, running.nTransactions);
+    BOOST_CHECK_EQUAL(computed.nTransactionOutputs, running.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(computed.nSerializedSize, running.nSerializedSize);
+    BOOST_CHECK_EQUAL(computed.nTotalAmount, running.nTotalAmount);
+    BOOST_CHECK(computed.hash.Finalize() == running.hash.Finalize());
+
+    // Removing what was added, as a delta, gets back to the empty set
+    CCoinsRunningStats delta;
+    for (std::map<uint256, CCoins>::const_iterator it = txs.begin(); it != txs.end(); it++) {
+        for (unsigned int n = 0; n < it->second.vout.size(); n++)
+            delta.RemoveOutput(COutPoint(it->first, n), it->second, it->second.vout[n]);
+    }
+    running.Apply(delta);
+    BOOST_CHECK_EQUAL(running.nTransactionOutputs, 0);
+    BOOST_CHECK_EQUAL(running.nTotalAmount, 0);
+    BOOST_CHECK(running.hash.Finalize() == CCoinsRunningStats().hash.Finalize());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "leveldbwrapper.h"
 #include "util.h"
 #include "test/test_nodezero.h"
 
@@ -161,4 +162,38 @@ BOOST_AUTO_TEST_CASE(boolargno)
     BOOST_CHECK(GetBoolArg("-foo", false));
 }
 
+BOOST_AUTO_TEST_CASE(dbtune)
+{
+    std::map<std::string, CLevelDBTuning> mapTuning;
+    mapTuning["chainstate"];
+    mapTuning["zerocoin"];
+    std::string strError;
+
+    ResetArgs("-dbtune=chainstate.cache=300 -dbtune=chainstate.bloombits=0 -dbtune=zerocoin.compression=1 -dbtune=zerocoin.writebuffer=8");
+    BOOST_CHECK(ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapTuning, strError));
+    BOOST_CHECK_EQUAL(mapTuning["chainstate"].nCacheSize, (size_t)300 << 20);
+    BOOST_CHECK_EQUAL(mapTuning["chainstate"].nBloomBits, 0);
+    BOOST_CHECK(!mapTuning["chainstate"].fCompression);
+    BOOST_CHECK(mapTuning["zerocoin"].fCompression);
+    BOOST_CHECK_EQUAL(mapTuning["zerocoin"].nWriteBufferSize, (size_t)8 << 20);
+    BOOST_CHECK_EQUAL(mapTuning["zerocoin"].nCacheSize, 0U);
+    BOOST_CHECK_EQUAL(mapTuning["zerocoin"].nBloomBits, 10);
+
+    ResetArgs("-dbtune=sporks.cache=1");
+    BOOST_CHECK(!ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapTuning, strError));
+    ResetArgs("-dbtune=chainstate.blocksize=1");
+    BOOST_CHECK(!ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapTuning, strError));
+    ResetArgs("-dbtune=chainstate.cache");
+    BOOST_CHECK(!ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapTuning, strError));
+    ResetArgs("-dbtune=chainstate.cache=-1");
+    BOOST_CHECK(!ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapTuning, strError));
+    ResetArgs("-dbtune=chainstate.cache=9223372036854775807");
+    BOOST_CHECK(!ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapTuning, strError));
+    ResetArgs("-dbtune=zerocoin.writebuffer=8796093022208");
+    BOOST_CHECK(!ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapTuning, strError));
+    ResetArgs("-dbtune=chainstate.cache=1024");
+    BOOST_CHECK(ParseLevelDBTuning(mapMultiArgs["-dbtune"], mapTuning, strError));
+    BOOST_CHECK_EQUAL(mapTuning["chainstate"].nCacheSize, (size_t)1024 << 20);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,11 +4,19 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockcache.h"
+#include "blockfilewriter.h"
 #include "primitives/transaction.h"
 #include "main.h"
+#include "pow.h"
 #include "test_nodezero.h"
+#include "txdb.h"
+#include "zNZRchain.h"
+
+#include <stdexcept>
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(main_tests, TestingSetup)
 
@@ -49,4 +57,217 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 4109975100000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(block_cache_test)
+{
+    std::vector<std::shared_ptr<const CBlock> > vBlocks;
+    for (int i = 0; i < 4; i++) {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        pblock->nNonce = i;
+        CMutableTransaction tx;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = i;
+        pblock->vtx.push_back(tx);
+        pblock->BuildMerkleTree();
+        vBlocks.push_back(pblock);
+    }
+
+    // Size the cache for two of the blocks
+    CBlockCache cache(1 << 20);
+    cache.Insert(vBlocks[0]->GetHash(), vBlocks[0]);
+    size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > 0);
+    cache.SetMaxUsage(nUsage * 2);
+
+    cache.Insert(vBlocks[1]->GetHash(), vBlocks[1]);
+    BOOST_CHECK_EQUAL(cache.GetSize(), 2U);
+    BOOST_CHECK(cache.Get(vBlocks[0]->GetHash()) == vBlocks[0]);
+
+    // Block 1 is now the least recently used and gets evicted
+    cache.Insert(vBlocks[2]->GetHash(), vBlocks[2]);
+    BOOST_CHECK_EQUAL(cache.GetSize(), 2U);
+    BOOST_CHECK(cache.Contains(vBlocks[0]->GetHash()));
+    BOOST_CHECK(!cache.Get(vBlocks[1]->GetHash()));
+    BOOST_CHECK(cache.Get(vBlocks[2]->GetHash()) == vBlocks[2]);
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= nUsage * 2);
+
+    // A block that doesn't fit at all is not added
+    cache.SetMaxUsage(nUsage / 2);
+    BOOST_CHECK_EQUAL(cache.GetSize(), 0U);
+    cache.Insert(vBlocks[3]->GetHash(), vBlocks[3]);
+    BOOST_CHECK(!cache.Contains(vBlocks[3]->GetHash()));
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(block_file_writer_test)
+{
+    CBlock block = Params().GenesisBlock();
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(COIN, CScript() << OP_TRUE), true, false, 10));
+
+    // Positions in files InitBlockIndex didn't write to
+    CDiskBlockPos posBlock(100, 0);
+    CDiskBlockPos posUndo(100, 0);
+    pblockWriter = new CBlockFileWriter(1 << 20);
+    BOOST_CHECK(WriteBlockToDisk(block, posBlock));
+    BOOST_CHECK(blockundo.WriteToDisk(posUndo, block.GetHash()));
+    BOOST_CHECK_EQUAL(posBlock.nPos, 8U);
+    BOOST_CHECK_EQUAL(posUndo.nPos, 8U);
+
+    // Readable whether or not the writer got to it yet
+    CBlock blockRead;
+    CBlockUndo undoRead;
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, posBlock));
+    BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+    BOOST_CHECK(undoRead.ReadFromDisk(posUndo, block.GetHash()));
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), 1U);
+
+    // Nothing is queued once flushed, and the data is in the files
+    BOOST_CHECK(pblockWriter->Flush());
+    unsigned int nOffset;
+    BOOST_CHECK(!pblockWriter->GetPending(posBlock, false, nOffset));
+    BOOST_CHECK(!pblockWriter->GetPending(posUndo, true, nOffset));
+    delete pblockWriter;
+    pblockWriter = NULL;
+
+    blockRead.SetNull();
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, posBlock));
+    BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+    undoRead.vtxundo.clear();
+    BOOST_CHECK(undoRead.ReadFromDisk(posUndo, block.GetHash()));
+    BOOST_CHECK_EQUAL(undoRead.vtxundo.size(), 1U);
+    BOOST_CHECK(undoRead.vtxundo[0].vprevout[0].txout.nValue == COIN);
+}
+
+// Blocks connected before the pubcoin index existed are indexed the first time they are looked up
+BOOST_AUTO_TEST_CASE(pubcoin_index_lazy_fill_test)
+{
+    CZerocoinDB* zerocoinDBPrev = zerocoinDB;
+    zerocoinDB = new CZerocoinDB(1 << 20, true);
+    const CBlockIndex* pindex = chainActive.Genesis();
+    std::vector<CBigNum> vValues;
+    BOOST_CHECK(!zerocoinDB->ReadBlockMints(pindex->GetBlockHash(), libzerocoin::ZQ_ONE, vValues));
+
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    BOOST_CHECK(BlockIndexToPubcoinList(pindex, libzerocoin::ZQ_ONE, listPubcoins));
+    BOOST_CHECK(listPubcoins.empty());
+    for (const libzerocoin::CoinDenomination denom : libzerocoin::zerocoinDenomList) {
+        BOOST_CHECK(zerocoinDB->ReadBlockMints(pindex->GetBlockHash(), denom, vValues));
+        BOOST_CHECK(vValues.empty());
+    }
+
+    delete zerocoinDB;
+    zerocoinDB = zerocoinDBPrev;
+}
+
+
+BOOST_AUTO_TEST_CASE(header_work_test)
+{
+    LOCK(cs_main);
+    const CBlockIndex* pindexPrev = chainActive.Tip();
+    CBlockHeader header;
+    header.hashPrevBlock = pindexPrev->GetBlockHash();
+    header.nTime = pindexPrev->nTime + 60;
+    header.nBits = GetNextWorkRequired(pindexPrev, &header);
+    BOOST_CHECK(CheckHeaderWork(header, pindexPrev));
+
+    // Sixteen times the difficulty is past the tolerance of the early blocks
+    uint256 bnTarget;
+    bnTarget.SetCompact(header.nBits);
+    bnTarget >>= 4;
+    header.nBits = bnTarget.GetCompact();
+    BOOST_CHECK(!CheckHeaderWork(header, pindexPrev));
+}
+
+BOOST_AUTO_TEST_CASE(headers_without_data_test)
+{
+    LOCK(cs_main);
+    uint256 nWorkAhead = chainActive.Tip()->nChainWork;
+    nWorkAhead += 1;
+    CBlockIndex indexAhead, indexHaveData, indexBehind;
+    indexAhead.nChainWork = nWorkAhead;
+    indexHaveData.nChainWork = nWorkAhead;
+    indexHaveData.nStatus = BLOCK_HAVE_DATA;
+    indexBehind.nChainWork = chainActive.Tip()->nChainWork;
+
+    // Only the oldest resolved headers go, all of them when asked to
+    std::deque<CBlockIndex*> vHeaders = {&indexHaveData, &indexAhead, &indexBehind};
+    BOOST_CHECK(PruneHeadersWithoutData(vHeaders, false));
+    BOOST_CHECK(vHeaders.size() == 2 && vHeaders.front() == &indexAhead);
+    BOOST_CHECK(!PruneHeadersWithoutData(vHeaders, false));
+    BOOST_CHECK(PruneHeadersWithoutData(vHeaders, true));
+    BOOST_CHECK(vHeaders.size() == 1 && vHeaders.front() == &indexAhead);
+    BOOST_CHECK(!PruneHeadersWithoutData(vHeaders, true));
+}
+
+BOOST_AUTO_TEST_CASE(blocks_waiting_for_parent_test)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(100000, 1);
+    CBlock block;
+    block.hashPrevBlock = GetRandHash();
+    block.vtx.push_back(tx);
+    size_t nBlockSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+
+    LOCK(cs_main);
+    BOOST_CHECK(AddBlockWaitingForParent(0, block));
+    BOOST_CHECK(!AddBlockWaitingForParent(0, block));
+
+    // Large blocks fill the queue by size long before its count limit
+    size_t nBlocks = 1;
+    while (nBlocks <= BLOCK_DOWNLOAD_WINDOW) {
+        block.nNonce++;
+        if (!AddBlockWaitingForParent(0, block))
+            break;
+        nBlocks++;
+    }
+    BOOST_CHECK_EQUAL(nBlocks, MAX_BLOCKS_WAITING_FOR_PARENT_SIZE / nBlockSize);
+    BOOST_CHECK(nBlocks < BLOCK_DOWNLOAD_WINDOW);
+}
+
+//! Stand-in for the block reader: later blocks finish first, and block 37 is corrupt
+static void ReindexTestBlock(const CBlockIndex* pindex, CZerocoinReindexEntry& entry)
+{
+    MilliSleep((10 - pindex->nHeight % 10) / 2);
+    if (pindex->nHeight == 37)
+        throw std::runtime_error("corrupt block");
+    entry.hashBlock = uint256(pindex->nHeight);
+}
+
+BOOST_AUTO_TEST_CASE(zerocoin_reindex_queue_test)
+{
+    std::vector<CBlockIndex> vIndex(100);
+    CZerocoinReindexQueue queue;
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        vIndex[i].nHeight = i;
+        queue.vBlocks.push_back(&vIndex[i]);
+    }
+
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++)
+        threadGroup.create_thread(boost::bind(&ThreadReindexZerocoin, &queue, &ReindexTestBlock));
+
+    // The writer gets the entries in block order, and the block that threw still gets one
+    for (size_t nBlock = 0; nBlock < queue.vBlocks.size(); nBlock++) {
+        CZerocoinReindexEntry entry = TakeReindexEntry(queue, nBlock);
+        if (nBlock == 37) {
+            BOOST_CHECK(!entry.strError.empty());
+            BOOST_CHECK(entry.hashBlock == 0);
+        } else {
+            BOOST_CHECK(entry.strError.empty());
+            BOOST_CHECK(entry.hashBlock == uint256(nBlock));
+        }
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(queue.mutex);
+        queue.fStop = true;
+        queue.condWork.notify_all();
+    }
+    threadGroup.join_all();
+    BOOST_CHECK(queue.mapDone.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,13 +2,16 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockfilemap.h"
 #include "serialize.h"
 #include "streams.h"
 #include "hash.h"
 #include "test/test_nodezero.h"
+#include "util.h"
 
 #include <stdint.h>
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
 
@@ -162,4 +165,62 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+
+BOOST_AUTO_TEST_CASE(span_reader)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << (uint32_t)0x01020304 << std::string("span") << VARINT(1000);
+    std::vector<unsigned char> vch(ss.begin(), ss.end());
+
+    CSpanReader reader(&vch[0], &vch[0] + vch.size(), SER_DISK, 0);
+    uint32_t n;
+    std::string str;
+    int nVarInt;
+    reader >> n;
+    BOOST_CHECK_EQUAL(n, 0x01020304U);
+    reader.ignore(1);
+    reader >> FLATDATA(n);
+    BOOST_CHECK_EQUAL(std::string((char*)&n, 4), "span");
+    reader >> VARINT(nVarInt);
+    BOOST_CHECK_EQUAL(nVarInt, 1000);
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+    BOOST_CHECK_THROW(reader.ignore(1), std::ios_base::failure);
+
+    CSpanReader reader2(&vch[0], &vch[0] + vch.size(), SER_DISK, 0);
+    reader2.ignore(4);
+    reader2 >> str;
+    BOOST_CHECK_EQUAL(str, "span");
+}
+
+BOOST_AUTO_TEST_CASE(mapped_file)
+{
+    boost::filesystem::path path = GetTempPath() / boost::filesystem::unique_path();
+    {
+        CAutoFile file(fopen(path.string().c_str(), "wb"), SER_DISK, 0);
+        BOOST_REQUIRE(!file.IsNull());
+        file << (uint32_t)7 << std::string("mapped");
+    }
+
+    std::shared_ptr<const CMappedFile> mapped = CMappedFile::Open(path);
+#ifndef WIN32
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->size(), 11U);
+    std::string str;
+    CSpanReader reader = mapped->GetReader(4, SER_DISK, 0);
+    reader >> str;
+    BOOST_CHECK_EQUAL(str, "mapped");
+    BOOST_CHECK(mapped->GetReader(11, SER_DISK, 0).empty());
+    BOOST_CHECK(mapped->GetReader(100, SER_DISK, 0).empty());
+
+    // The mapping stays readable after the file is removed
+    boost::filesystem::remove(path);
+    reader = mapped->GetReader(4, SER_DISK, 0);
+    reader >> str;
+    BOOST_CHECK_EQUAL(str, "mapped");
+#endif
+    boost::filesystem::remove(path);
+    BOOST_CHECK(!CMappedFile::Open(path));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
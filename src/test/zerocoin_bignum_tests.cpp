@@ -89,4 +89,48 @@ BOOST_AUTO_TEST_CASE(bignum_random_generation_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bignum_montgomery_tests)
+{
+    for (int bits : {64, 556, 1024, 2048, 5000}) {
+        CBigNum m = CBigNum::randKBitBignum(bits);
+        if (m % 2 == 0)
+            ++m;
+        CBigNumMontgomery mont(m);
+        for (int i = 0; i < 10; i++) {
+            CBigNum a = CBigNum::randKBitBignum(bits + 32);
+            CBigNum b = CBigNum::randBignum(m);
+            CBigNum e = CBigNum::randKBitBignum(300);
+            BOOST_CHECK(mont.fromMont(mont.toMont(a)) == a % m);
+            BOOST_CHECK(mont.mul_mod(a, b) == a.mul_mod(b, m));
+            BOOST_CHECK(mont.pow_mod(b, e) == b.pow_mod(e, m));
+            BOOST_CHECK(CBigNum::multi_pow_mod({a, b}, {e, e + 1}, mont) == a.pow_mod(e, m).mul_mod(b.pow_mod(e + 1, m), m));
+        }
+    }
+    BOOST_CHECK_THROW(CBigNumMontgomery(CBigNum(1024)), bignum_error);
+}
+
+BOOST_AUTO_TEST_CASE(bignum_vartime_exponentiation_tests)
+{
+    CBigNum N;
+    N.SetDec(zerocoinModulus);
+    libzerocoin::ZerocoinParams params(N);
+    const libzerocoin::IntegerGroupParams& group = params.serialNumberSoKCommitmentGroup;
+    const libzerocoin::AccumulatorAndProofParams& accParams = params.accumulatorParams;
+    const CBigNum& g_n = accParams.accumulatorQRNCommitmentGroup.g;
+    const CBigNum& h_n = accParams.accumulatorQRNCommitmentGroup.h;
+
+    for (int i = 0; i < 10; i++) {
+        CBigNum e = CBigNum::randBignum(group.groupOrder);
+        BOOST_CHECK(group.gPowVartime(e) == group.g.pow_mod(e, group.modulus));
+        BOOST_CHECK(group.hPowVartime(e) == group.h.pow_mod(e, group.modulus));
+
+        CBigNum a = CBigNum::randKBitBignum(3000);
+        CBigNum b = CBigNum(0) - CBigNum::randKBitBignum(2000);
+        BOOST_CHECK(accParams.qrnGPowVartime(a) == g_n.pow_mod(a, accParams.accumulatorModulus));
+        BOOST_CHECK(accParams.qrnHPowVartime(b) == h_n.inverse(accParams.accumulatorModulus).pow_mod(CBigNum(0) - b, accParams.accumulatorModulus));
+        BOOST_CHECK(CBigNum::multi_pow_mod({g_n, h_n}, {a, b}, accParams.accumulatorModulus) ==
+                    accParams.qrnGPowVartime(a).mul_mod(accParams.qrnHPowVartime(b), accParams.accumulatorModulus));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,12 +7,14 @@
 #include "libzerocoin/Denominations.h"
 #include "libzerocoin/CoinSpend.h"
 #include "libzerocoin/Accumulator.h"
+#include "zNZR/accumulators.h"
 #include "zNZR/zerocoin.h"
 #include "zNZR/deterministicmint.h"
 #include "zNZR/zNZRwallet.h"
 #include "libzerocoin/Coin.h"
 #include "amount.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
 #include "main.h"
 #include "wallet/wallet.h"
@@ -20,6 +22,7 @@
 #include "txdb.h"
 #include "test/test_nodezero.h"
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <iostream>
 
 
@@ -91,4 +94,80 @@ BOOST_AUTO_TEST_CASE(zerocoin_wrapped_serial_spend_test)
 
 }
 
+//! A spend of a V2 coin from an accumulator that holds it, and an accumulator without it
+struct CSpendCheckSetup
+{
+    libzerocoin::ZerocoinParams* params;
+    libzerocoin::PrivateCoin coin;
+    libzerocoin::Accumulator accOther;
+    libzerocoin::Accumulator acc;
+    libzerocoin::CoinSpend spend;
+
+    CSpendCheckSetup() : params(Params().Zerocoin_Params(false)),
+                         coin(params, libzerocoin::CoinDenomination::ZQ_ONE),
+                         accOther(params, libzerocoin::CoinDenomination::ZQ_ONE),
+                         acc(params, libzerocoin::CoinDenomination::ZQ_ONE)
+    {
+        libzerocoin::PrivateCoin other(params, libzerocoin::CoinDenomination::ZQ_ONE);
+        accOther += other.getPublicCoin();
+        acc = accOther;
+        libzerocoin::AccumulatorWitness witness(params, acc, coin.getPublicCoin());
+        witness += other.getPublicCoin();
+        acc += coin.getPublicCoin();
+        spend = libzerocoin::CoinSpend(params, params, coin, acc, GetChecksum(acc.getValue()), witness, GetRandHash(), libzerocoin::SpendType::SPEND);
+    }
+};
+
+/**
+ * Check that a spend proof verified on a check queue gives the same result as an inline Verify.
+ */
+BOOST_AUTO_TEST_CASE(zerocoin_spend_check_test)
+{
+    CSpendCheckSetup setup;
+    CCheckQueue<CZerocoinSpendCheck> queue(1);
+    boost::thread_group threadGroup;
+    threadGroup.create_thread(boost::bind(&CCheckQueue<CZerocoinSpendCheck>::Thread, &queue));
+
+    // A valid spend passes on the queue, and then inline from the cache
+    BOOST_CHECK(setup.spend.Verify(setup.acc));
+    {
+        CCheckQueueControl<CZerocoinSpendCheck> control(&queue);
+        std::vector<CZerocoinSpendCheck> vChecks(1, CZerocoinSpendCheck(setup.spend, setup.params, setup.acc.getValue(), true));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK(CZerocoinSpendCheck(setup.spend, setup.params, setup.acc.getValue(), true)());
+
+    // The same spend is not a member of an accumulator without its coin
+    BOOST_CHECK(!setup.spend.Verify(setup.accOther));
+    {
+        CCheckQueueControl<CZerocoinSpendCheck> control(&queue);
+        std::vector<CZerocoinSpendCheck> vChecks(1, CZerocoinSpendCheck(setup.spend, setup.params, setup.accOther.getValue(), true));
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+    BOOST_CHECK(!CZerocoinSpendCheck(setup.spend, setup.params, setup.accOther.getValue(), true)());
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+/**
+ * Check that a verified spend is only taken from the cache under the modulus it was checked with.
+ */
+BOOST_AUTO_TEST_CASE(zerocoin_spend_cache_modulus_test)
+{
+    CSpendCheckSetup setup;
+    BOOST_CHECK(CZerocoinSpendCheck(setup.spend, setup.params, setup.acc.getValue(), true)());
+
+    // Read with the V1 modulus, as TxInToZerocoinSpend does below the V2 start, the proof no
+    // longer holds, whatever was cached for the V2 modulus
+    libzerocoin::ZerocoinParams* paramsV1 = Params().Zerocoin_Params(true);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << setup.spend;
+    libzerocoin::CoinSpend spendV1(paramsV1, paramsV1, ss);
+    BOOST_CHECK(!spendV1.Verify(libzerocoin::Accumulator(paramsV1, libzerocoin::CoinDenomination::ZQ_ONE, setup.acc.getValue())));
+    BOOST_CHECK(!CZerocoinSpendCheck(spendV1, paramsV1, setup.acc.getValue(), true)());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
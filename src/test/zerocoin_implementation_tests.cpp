@@ -458,6 +458,37 @@ BOOST_AUTO_TEST_CASE(checksum_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(accumulatormap_batch_tests)
+{
+    std::cout << "Running accumulatormap_batch_tests\n";
+
+    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    std::vector<libzerocoin::CoinDenomination> vDenoms {libzerocoin::ZQ_ONE, libzerocoin::ZQ_FIFTY, libzerocoin::ZQ_FIVE_THOUSAND};
+    for (int i = 0; i < 9; i++)
+        listPubcoins.emplace_back(libzerocoin::PublicCoin(params, CBigNum::randBignum(params->coinCommitmentGroup.modulus), vDenoms[i % 3]));
+
+    AccumulatorMap mapSerial(params);
+    for (const libzerocoin::PublicCoin& pubcoin : listPubcoins)
+        BOOST_CHECK(mapSerial.Accumulate(pubcoin, true));
+
+    // Accumulated inline, then through the check queue
+    int nScriptCheckThreadsPrev = nScriptCheckThreads;
+    for (int nThreads : {0, 2}) {
+        nScriptCheckThreads = nThreads;
+        AccumulatorMap mapBatch(params);
+        BOOST_CHECK(mapBatch.Accumulate(listPubcoins, true));
+        BOOST_CHECK_MESSAGE(mapBatch.GetCheckpoint() == mapSerial.GetCheckpoint(), "batch accumulation differs with " << nThreads << " threads");
+        for (auto& denom : libzerocoin::zerocoinDenomList)
+            BOOST_CHECK(mapBatch.GetValue(denom) == mapSerial.GetValue(denom));
+    }
+    nScriptCheckThreads = nScriptCheckThreadsPrev;
+
+    AccumulatorMap mapInvalid(params);
+    std::list<libzerocoin::PublicCoin> listInvalid {libzerocoin::PublicCoin(params)};
+    BOOST_CHECK(!mapInvalid.Accumulate(listInvalid, true));
+}
+
 BOOST_AUTO_TEST_CASE(test_checkpoints)
 {
     BOOST_CHECK_MESSAGE(AccumulatorCheckpoints::LoadCheckpoints("main"), "failed to load checkpoints");
@@ -6,22 +6,121 @@
 
 #include "txdb.h"
 
+#include "compat/endian.h"
+#include "guiinterface.h"
+#include "init.h"
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
+#include "util.h"
 #include "zNZR/accumulators.h"
 
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
+static const char DB_COINS = 'c';
+static const char DB_COIN = 'C';
+static const char DB_COIN_COUNT = 'N';
+static const char DB_COINS_STATS = 'S';
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+namespace {
+
+/**
+ * Key of one unspent output in the coin database. The output number is
+ * stored big endian, so that the outputs of a transaction are stored in order
+ * right after each other.
+ */
+struct CCoinKey {
+    uint256 txid;
+    uint32_t n;
+
+    CCoinKey(const uint256& txidIn, uint32_t nIn) : txid(txidIn), n(nIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 32 + 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        uint32_t nBE = htobe32(n);
+        ::Serialize(s, DB_COIN, nType, nVersion);
+        ::Serialize(s, txid, nType, nVersion);
+        s.write((const char*)&nBE, sizeof(nBE));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        char chType;
+        uint32_t nBE;
+        ::Unserialize(s, chType, nType, nVersion);
+        ::Unserialize(s, txid, nType, nVersion);
+        s.read((char*)&nBE, sizeof(nBE));
+        n = be32toh(nBE);
+    }
+};
+
+/** Value of one unspent output in the coin database, along with the metadata of its transaction */
+class CCoinRecord
+{
+public:
+    CTxOut out;
+    int nHeight;
+    int nVersion;
+    bool fCoinBase;
+    bool fCoinStake;
+
+    CCoinRecord() : nHeight(0), nVersion(0), fCoinBase(false), fCoinStake(false) {}
+    CCoinRecord(const CCoins& coins, unsigned int n) : out(coins.vout[n]), nHeight(coins.nHeight), nVersion(coins.nVersion),
+                                                       fCoinBase(coins.fCoinBase), fCoinStake(coins.fCoinStake) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersionIn)
+    {
+        unsigned int nCode = nHeight * 4 + (fCoinBase ? 1 : 0) + (fCoinStake ? 2 : 0);
+        READWRITE(VARINT(nVersion));
+        READWRITE(VARINT(nCode));
+        READWRITE(REF(CTxOutCompressor(out)));
+        if (ser_action.ForRead()) {
+            nHeight = nCode / 4;
+            fCoinBase = nCode & 1;
+            fCoinStake = (nCode & 2) != 0;
+        }
+    }
+};
+
+}
+
+/**
+ * Write the outputs of a cache entry that differ from what the database has:
+ * new unspent outputs are written and spent ones erased, the outputs that
+ * were already stored unspent are left alone. Next to its outputs every
+ * transaction keeps a record of how many outputs it has, so that it can be
+ * read back with point lookups; it is erased with the last output.
+ */
+void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoinsCacheEntry& entry)
 {
-    if (coins.IsPruned())
-        batch.Erase(std::make_pair('c', hash));
-    else
-        batch.Write(std::make_pair('c', hash), coins);
+    const CCoins& coins = entry.coins;
+    if (coins.IsPruned()) {
+        if (entry.nFetchedOutputs > 0)
+            batch.Erase(std::make_pair(DB_COIN_COUNT, hash));
+    } else if (coins.vout.size() != entry.nFetchedOutputs) {
+        batch.Write(std::make_pair(DB_COIN_COUNT, hash), (uint32_t)coins.vout.size());
+    }
+    unsigned int nOutputs = std::max((unsigned int)coins.vout.size(), (unsigned int)entry.nFetchedOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        if (i < coins.vout.size() && !coins.vout[i].IsNull()) {
+            if (!entry.HasFetched(i))
+                batch.Write(CCoinKey(hash, i), CCoinRecord(coins, i));
+        } else if (entry.MayHaveFetched(i)) {
+            batch.Erase(CCoinKey(hash, i));
+        }
+    }
 }
 
 void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
@@ -29,18 +128,36 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, const CLevelDBTuning& tuning) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, tuning)
 {
 }
 
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
-    return db.Read(std::make_pair('c', txid), coins);
+    uint32_t nOutputs;
+    if (!db.Read(std::make_pair(DB_COIN_COUNT, txid), nOutputs))
+        return false;
+
+    coins.Clear();
+    bool fFound = false;
+    for (uint32_t i = 0; i < nOutputs; i++) {
+        CCoinRecord record;
+        if (!db.Read(CCoinKey(txid, i), record))
+            continue;
+        coins.vout.resize(i + 1);
+        coins.vout[i] = record.out;
+        coins.nHeight = record.nHeight;
+        coins.nVersion = record.nVersion;
+        coins.fCoinBase = record.fCoinBase;
+        coins.fCoinStake = record.fCoinStake;
+        fFound = true;
+    }
+    return fFound;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
-    return db.Exists(std::make_pair('c', txid));
+    return db.Exists(std::make_pair(DB_COIN_COUNT, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
@@ -56,23 +173,276 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
+    // mapCoins is only read: a CCoinsViewAsyncWriter serves it to readers while it is written
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            BatchWriteCoins(batch, it->first, it->second);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        it++;
     }
-    if (hashBlock != uint256(0))
+    if (hashBlock != uint256(0)) {
         BatchWriteHashBestChain(batch, hashBlock);
+        // Statistics are only kept if they belong to the best block they are written with
+        LOCK(cs_stats);
+        std::map<uint256, CCoinsRunningStats>::iterator it = mapBlockStats.find(hashBlock);
+        if (it != mapBlockStats.end()) {
+            batch.Write(DB_COINS_STATS, it->second);
+            mapBlockStats.erase(it);
+        } else {
+            batch.Erase(DB_COINS_STATS);
+        }
+    }
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+void CCoinsViewDB::SetBlockStats(const CCoinsRunningStats& stats)
+{
+    LOCK(cs_stats);
+    mapBlockStats[stats.hashBlock] = stats;
+}
+
+bool CCoinsViewDB::ReadRunningStats(CCoinsRunningStats& stats) const
+{
+    if (!db.Read(DB_COINS_STATS, stats))
+        return false;
+    return stats.hashBlock == GetBestBlock();
+}
+
+bool CCoinsViewDB::ComputeRunningStats(CCoinsRunningStats& stats) const
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COIN;
+    pcursor->Seek(ssKeySet.str());
+
+    stats = CCoinsRunningStats();
+    stats.hashBlock = GetBestBlock();
+    BlockMap::const_iterator mi = mapBlockIndex.find(stats.hashBlock);
+    if (mi != mapBlockIndex.end())
+        stats.nHeight = mi->second->nHeight;
+    uint256 txhashPrev;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() == 0 || slKey[0] != DB_COIN)
+            break;
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        CCoinKey key(uint256(), 0);
+        CCoinRecord record;
+        try {
+            ssKey >> key;
+            ssValue >> record;
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        if (stats.nTransactionOutputs == 0 || key.txid != txhashPrev)
+            stats.nTransactions++;
+        txhashPrev = key.txid;
+        CCoins coins;
+        coins.nHeight = record.nHeight;
+        coins.fCoinBase = record.fCoinBase;
+        stats.AddOutput(COutPoint(key.txid, key.n), coins, record.out);
+    }
+    return true;
+}
+
+CCoinsViewAsyncWriter::CCoinsViewAsyncWriter(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), hashPending(0), fWriting(false), fFailed(false), fStop(false)
+{
+    threadWrite = std::thread([this] { TraceThread("coinswrite", [this] { ThreadWrite(); }); });
+}
+
+CCoinsViewAsyncWriter::~CCoinsViewAsyncWriter()
+{
+    {
+        WaitableLock lock(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    threadWrite.join();
+}
+
+void CCoinsViewAsyncWriter::ThreadWrite()
+{
+    WaitableLock lock(cs);
+    while (true) {
+        while (!fWriting && !fStop)
+            cond.wait(lock);
+        // A pending write is finished before stopping
+        if (!fWriting)
+            return;
+
+        lock.unlock();
+        int64_t nStart = GetTimeMicros();
+        size_t nEntries = mapPending.size();
+        bool fOk = false;
+        try {
+            fOk = base->BatchWrite(mapPending, hashPending);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : %s\n", __func__, e.what());
+        }
+        LogPrint("coindb", "%s : wrote %u entries in %.2fms\n", __func__, (unsigned int)nEntries, 0.001 * (GetTimeMicros() - nStart));
+        lock.lock();
+
+        mapPending.clear();
+        fWriting = false;
+        if (!fOk)
+            fFailed = true;
+        cond.notify_all();
+    }
+}
+
+bool CCoinsViewAsyncWriter::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        WaitableLock lock(cs);
+        if (fWriting) {
+            CCoinsMap::const_iterator it = mapPending.find(txid);
+            if (it != mapPending.end()) {
+                coins = it->second.coins;
+                return true;
+            }
+        }
+    }
+    // Entries that are not being written are not touched by the write
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewAsyncWriter::HaveCoins(const uint256& txid) const
+{
+    {
+        WaitableLock lock(cs);
+        if (fWriting) {
+            CCoinsMap::const_iterator it = mapPending.find(txid);
+            if (it != mapPending.end())
+                return !it->second.coins.IsPruned();
+        }
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewAsyncWriter::GetBestBlock() const
+{
+    {
+        WaitableLock lock(cs);
+        if (fWriting && hashPending != uint256(0))
+            return hashPending;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewAsyncWriter::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    if (!Sync())
+        return false;
+    {
+        WaitableLock lock(cs);
+        mapPending.swap(mapCoins);
+        hashPending = hashBlock;
+        fWriting = true;
+    }
+    cond.notify_all();
+    return true;
+}
+
+bool CCoinsViewAsyncWriter::GetStats(CCoinsStats& stats) const
+{
+    if (!Sync())
+        return false;
+    return base->GetStats(stats);
+}
+
+bool CCoinsViewAsyncWriter::Sync() const
+{
+    WaitableLock lock(cs);
+    while (fWriting)
+        cond.wait(lock);
+    return !fFailed;
+}
+
+bool CCoinsViewAsyncWriter::HasFailed() const
+{
+    WaitableLock lock(cs);
+    return fFailed;
+}
+
+bool CCoinsViewDB::Upgrade()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COINS;
+    pcursor->Seek(ssKeySet.str());
+    if (!pcursor->Valid() || pcursor->key().size() == 0 || pcursor->key()[0] != DB_COINS)
+        return true;
+
+    LogPrintf("Upgrading chainstate database to one record per output...\n");
+    uiInterface.InitMessage(_("Upgrading chainstate database..."));
+    uiInterface.ShowProgress(_("Upgrading chainstate database..."), 0);
+    // The old records of each batch are erased along with the new ones being written,
+    // so an interrupted upgrade continues where it left off on the next start.
+    CLevelDBBatch batch;
+    size_t nBatchTx = 0;
+    size_t nTx = 0, nOutputs = 0;
+    int nReportDone = 0;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            break;
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() == 0 || slKey[0] != DB_COINS)
+            break;
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        leveldb::Slice slValue = pcursor->value();
+        CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+        char chType;
+        uint256 txid;
+        CCoins coins;
+        try {
+            ssKey >> chType >> txid;
+            ssValue >> coins;
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull()) {
+                batch.Write(CCoinKey(txid, i), CCoinRecord(coins, i));
+                nOutputs++;
+            }
+        }
+        if (!coins.IsPruned())
+            batch.Write(std::make_pair(DB_COIN_COUNT, txid), (uint32_t)coins.vout.size());
+        batch.Erase(std::make_pair(DB_COINS, txid));
+        nTx++;
+
+        if (++nBatchTx >= 10000) {
+            if (!db.WriteBatch(batch))
+                return error("%s : failed to write upgraded coins", __func__);
+            batch.Clear();
+            nBatchTx = 0;
+            // Records are ordered by the serialized txid, so its first byte tells how far along the upgrade is
+            int nDone = (int)*txid.begin() * 100 / 256;
+            if (nDone > nReportDone) {
+                nReportDone = nDone;
+                uiInterface.ShowProgress(_("Upgrading chainstate database..."), nDone);
+                LogPrintf("[%d%%]...", nDone);
+            }
+        }
+    }
+    if (nBatchTx > 0 && !db.WriteBatch(batch))
+        return error("%s : failed to write upgraded coins", __func__);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("%s : converted %u transactions into %u outputs%s\n", __func__, nTx, nOutputs, ShutdownRequested() ? ", interrupted" : "");
+    // An interrupted upgrade is not an error, it continues on the next start
+    return true;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, const CLevelDBTuning& tuning) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, tuning)
 {
 }
 
@@ -107,55 +477,11 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
-            }
-            pcursor->Next();
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        }
-    }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+    // The same statistics that are kept up to date at the tip, computed from scratch
+    CCoinsRunningStats running;
+    if (!ComputeRunningStats(running))
+        return false;
+    running.GetStats(stats);
     return true;
 }
 
@@ -208,90 +534,173 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+namespace {
+
+//! A block index entry read from disk, before it is linked into mapBlockIndex
+struct CBlockIndexLoaded {
+    uint256 hash;
+    uint256 hashPrev;
+    uint256 hashNext;
+    CBlockIndex* pindex;
+};
+
+}
+
+/**
+ * Read the block index entries whose hash starts with a byte in [nBegin, nEnd).
+ * Runs on its own thread: the entries are only collected here, they are
+ * inserted into mapBlockIndex once all ranges are read.
+ */
+bool static LoadBlockIndexRange(CBlockTreeDB& db, unsigned int nBegin, unsigned int nEnd, std::vector<CBlockIndexLoaded>& vLoaded, std::string& strError)
 {
-    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
 
+    uint256 hashStart(0);
+    *hashStart.begin() = nBegin;
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << std::make_pair('b', uint256(0));
+    ssKeySet << std::make_pair('b', hashStart);
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
-    uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
+    try {
+        for (; pcursor->Valid(); pcursor->Next()) {
             leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
-                    pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                } else {
-                    pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
-                }
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+            if (slKey.size() < 2 || slKey[0] != 'b' || (unsigned char)slKey[1] >= nEnd)
+                break;
+            if (ShutdownRequested()) {
+                strError = "shutdown requested";
+                return false;
+            }
 
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CDiskBlockIndex diskindex;
+            ssValue >> diskindex;
+
+            // Construct block index object; pointers and hash are set when it is linked
+            CBlockIndexLoaded loaded;
+            loaded.hash = diskindex.GetBlockHash();
+            loaded.hashPrev = diskindex.hashPrev;
+            loaded.hashNext = diskindex.hashNext;
+            CBlockIndex* pindexNew = loaded.pindex = new CBlockIndex();
+            vLoaded.push_back(loaded);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //zerocoin
+            pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+            pindexNew->zerocoinSupply = diskindex.zerocoinSupply;
+            pindexNew->vMintDenominationsInBlock.swap(diskindex.vMintDenominationsInBlock);
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            if (!Params().IsStakeModifierV2(pindexNew->nHeight)) {
+                pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            } else {
+                pindexNew->nStakeModifierV2 = diskindex.nStakeModifierV2;
+            }
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+            pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+            if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
+                if (!CheckProofOfWork(loaded.hash, pindexNew->nBits)) {
+                    strError = strprintf("CheckProofOfWork failed: height=%d hash=%s", pindexNew->nHeight, loaded.hash.ToString());
+                    return false;
                 }
+            }
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("Deserialize or I/O error - %s", e.what());
+        return false;
+    }
+    return true;
+}
 
-                //populate accumulator checksum map in memory
-                if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
-                    //Don't load any checkpoints that exist before v2 zNZR. The accumulator is invalid for v1 and not used.
-                    if (pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
-                        LoadAccumulatorValuesFromDB(pindexNew->nAccumulatorCheckpoint);
-
-                    nPreviousCheckpoint = pindexNew->nAccumulatorCheckpoint;
-                }
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    // Deserializing and hashing the entries is split over threads by the first
+    // byte of the block hash, which spreads them evenly.
+    int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<std::vector<CBlockIndexLoaded> > vvLoaded(nThreads);
+    std::vector<std::string> vError(nThreads);
+    std::vector<char> vOk(nThreads, 0);
+    std::vector<std::thread> vThreads;
+    for (int i = 0; i < nThreads; i++) {
+        unsigned int nBegin = 256 * i / nThreads, nEnd = 256 * (i + 1) / nThreads;
+        vThreads.push_back(std::thread([&, i, nBegin, nEnd] {
+            RenameThread("nodezero-loadidx");
+            vOk[i] = LoadBlockIndexRange(*this, nBegin, nEnd, vvLoaded[i], vError[i]);
+        }));
+    }
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    size_t nLoaded = 0;
+    bool fOk = true;
+    for (int i = 0; i < nThreads; i++) {
+        nLoaded += vvLoaded[i].size();
+        if (!vOk[i]) {
+            fOk = false;
+            error("LoadBlockIndex() : %s", vError[i]);
+        }
+    }
+    if (!fOk) {
+        for (const std::vector<CBlockIndexLoaded>& vLoaded : vvLoaded) {
+            for (const CBlockIndexLoaded& loaded : vLoaded)
+                delete loaded.pindex;
+        }
+        return false;
+    }
+    boost::this_thread::interruption_point();
 
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+    // Load mapBlockIndex
+    mapBlockIndex.rehash(std::max(mapBlockIndex.bucket_count(), (size_t)((mapBlockIndex.size() + nLoaded) / mapBlockIndex.max_load_factor()) + 1));
+    for (std::vector<CBlockIndexLoaded>& vLoaded : vvLoaded) {
+        for (CBlockIndexLoaded& loaded : vLoaded) {
+            std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(std::make_pair(loaded.hash, loaded.pindex));
+            if (!ret.second) {
+                // Already created as the predecessor or successor of another entry
+                CBlockIndex* pindexNew = loaded.pindex;
+                *ret.first->second = *pindexNew;
+                delete pindexNew;
+                loaded.pindex = ret.first->second;
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            loaded.pindex->phashBlock = &ret.first->first;
+        }
+    }
+    std::set<uint256> setCheckpoints;
+    for (const std::vector<CBlockIndexLoaded>& vLoaded : vvLoaded) {
+        for (const CBlockIndexLoaded& loaded : vLoaded) {
+            CBlockIndex* pindexNew = loaded.pindex;
+            pindexNew->pprev = InsertBlockIndex(loaded.hashPrev);
+            pindexNew->pnext = InsertBlockIndex(loaded.hashNext);
+
+            //Don't load any checkpoints that exist before v2 zNZR. The accumulator is invalid for v1 and not used.
+            if (pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nHeight >= Params().Zerocoin_Block_V2_Start())
+                setCheckpoints.insert(pindexNew->nAccumulatorCheckpoint);
         }
     }
 
+    //populate accumulator checksum map in memory
+    for (const uint256& nCheckpoint : setCheckpoints)
+        LoadAccumulatorValuesFromDB(nCheckpoint);
+
+    LogPrintf("%s : loaded %u block index entries using %d threads\n", __func__, (unsigned int)nLoaded, nThreads);
     return true;
 }
 
-CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe)
+CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe, const CLevelDBTuning& tuning) : CLevelDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe, tuning)
 {
 }
 
@@ -425,3 +834,68 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(std::make_pair('2', nChecksum));
 }
+
+bool CZerocoinDB::WriteBlockMints(const uint256& hashBlock, const std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> >& mapPubcoins)
+{
+    CLevelDBBatch batch;
+    for (const auto& denomMints : mapPubcoins)
+        batch.Write(std::make_pair('b', std::make_pair(hashBlock, (int)denomMints.first)), denomMints.second);
+
+    return WriteBatch(batch);
+}
+
+bool CZerocoinDB::ReadBlockMints(const uint256& hashBlock, const libzerocoin::CoinDenomination denom, std::vector<CBigNum>& vValues)
+{
+    return Read(std::make_pair('b', std::make_pair(hashBlock, (int)denom)), vValues);
+}
+
+bool CZerocoinDB::EraseBlockMints(const uint256& hashBlock)
+{
+    CLevelDBBatch batch;
+    for (const libzerocoin::CoinDenomination denom : libzerocoin::zerocoinDenomList)
+        batch.Erase(std::make_pair('b', std::make_pair(hashBlock, (int)denom)));
+
+    return WriteBatch(batch);
+}
+
+bool CZerocoinDB::WriteReindexBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo,
+                                    const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo,
+                                    const std::vector<std::pair<uint256, std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> > > >& vBlockMints,
+                                    int nHeight)
+{
+    CLevelDBBatch batch;
+    for (const auto& spend : spendInfo) {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << spend.first.getCoinSerialNumber();
+        uint256 hash = Hash(ss.begin(), ss.end());
+        batch.Write(std::make_pair('s', hash), spend.second);
+    }
+
+    for (const auto& mint : mintInfo)
+        batch.Write(std::make_pair('m', GetPubCoinHash(mint.first.getValue())), mint.second);
+
+    for (const auto& blockMints : vBlockMints) {
+        for (const auto& denomMints : blockMints.second)
+            batch.Write(std::make_pair('b', std::make_pair(blockMints.first, (int)denomMints.first)), denomMints.second);
+    }
+
+    batch.Write('R', nHeight);
+
+    LogPrint("zero", "Writing %u coin spends and %u coin mints to db, reindexed up to %d.\n", (unsigned int)spendInfo.size(), (unsigned int)mintInfo.size(), nHeight);
+    return WriteBatch(batch, true);
+}
+
+bool CZerocoinDB::WriteReindexProgress(int nHeight)
+{
+    return Write('R', nHeight, true);
+}
+
+bool CZerocoinDB::ReadReindexProgress(int& nHeight)
+{
+    return Read('R', nHeight);
+}
+
+bool CZerocoinDB::EraseReindexProgress()
+{
+    return Erase('R', true);
+}
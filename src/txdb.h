@@ -9,12 +9,14 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "coinstats.h"
 #include "leveldbwrapper.h"
 #include "main.h"
 #include "zNZR/zerocoin.h"
 
 #include <map>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -27,6 +29,10 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! max. threads reading the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -34,21 +40,76 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CLevelDBWrapper db;
 
+    mutable CCriticalSection cs_stats;
+    //! statistics to write along with the coins of these best blocks
+    std::map<uint256, CCoinsRunningStats> mapBlockStats;
+
+public:
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CLevelDBTuning& tuning = CLevelDBTuning());
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool GetStats(CCoinsStats& stats) const;
+
+    //! Convert a chainstate with one record per transaction to one record per unspent output
+    bool Upgrade();
+
+    //! Persist stats when the coins of stats.hashBlock are written
+    void SetBlockStats(const CCoinsRunningStats& stats);
+    //! Read the persisted statistics, false if missing or not of the best block
+    bool ReadRunningStats(CCoinsRunningStats& stats) const;
+    //! Compute the statistics of the best block from all coins
+    bool ComputeRunningStats(CCoinsRunningStats& stats) const;
+
+    void GetDBStats(CLevelDBStats& stats) const { db.GetStats(stats); }
+};
+
+/**
+ * CCoinsView that writes the changes flushed into it to its backend from a
+ * dedicated thread. While a write is in progress the flushed entries are
+ * served from memory, so the cache above can keep working; the entries and
+ * the best block are handed to the backend in a single BatchWrite, which
+ * keeps the database consistent if the write is interrupted.
+ */
+class CCoinsViewAsyncWriter : public CCoinsViewBacked
+{
+private:
+    mutable CWaitableCriticalSection cs;
+    mutable CConditionVariable cond;
+    //! the entries being written, read-only until the write finishes
+    CCoinsMap mapPending;
+    uint256 hashPending;
+    bool fWriting;
+    bool fFailed;
+    bool fStop;
+    std::thread threadWrite;
+
+    void ThreadWrite();
+
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewAsyncWriter(CCoinsView* viewIn);
+    ~CCoinsViewAsyncWriter();
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
+    //! Waits for the previous write to finish and starts writing mapCoins
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    //! Wait until everything flushed so far is on disk; false if a write failed
+    bool Sync() const;
+    //! Whether a finished write failed
+    bool HasFailed() const;
 };
 
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CLevelDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CLevelDBTuning& tuning = CLevelDBTuning());
 
 private:
     CBlockTreeDB(const CBlockTreeDB&);
@@ -74,7 +135,7 @@ public:
 class CZerocoinDB : public CLevelDBWrapper
 {
 public:
-    CZerocoinDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CZerocoinDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CLevelDBTuning& tuning = CLevelDBTuning());
 
 private:
     CZerocoinDB(const CZerocoinDB&);
@@ -95,6 +156,18 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    /** Index of the valid pubcoin values minted in a block, by denomination */
+    bool WriteBlockMints(const uint256& hashBlock, const std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> >& mapPubcoins);
+    bool ReadBlockMints(const uint256& hashBlock, const libzerocoin::CoinDenomination denom, std::vector<CBigNum>& vValues);
+    bool EraseBlockMints(const uint256& hashBlock);
+    /** Write the entries of a range of reindexed blocks in one batch, together with the height they reach */
+    bool WriteReindexBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo,
+                           const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo,
+                           const std::vector<std::pair<uint256, std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> > > >& vBlockMints,
+                           int nHeight);
+    bool WriteReindexProgress(int nHeight);
+    bool ReadReindexProgress(int& nHeight);
+    bool EraseReindexProgress();
 };
 
 #endif // BITCOIN_TXDB_H
@@ -13,7 +13,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 80002;
+static const int PROTOCOL_VERSION = 80003;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -41,5 +41,8 @@ static const int MEMPOOL_GD_VERSION = 60002;
 //! "filter*" commands are disabled without NODE_BLOOM after and including this version
 static const int NO_BLOOM_VERSION = 70005;
 
+//! 'getheaders' is answered with 'headers' instead of an inventory from this version on
+static const int HEADERS_FIRST_VERSION = 80003;
+
 
 #endif // BITCOIN_VERSION_H
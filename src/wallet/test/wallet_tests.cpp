@@ -304,4 +304,24 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(zerocoin_witness_thread_test)
+{
+    CWallet walletWitnesses;
+    std::vector<CBlockIndex> vIndex(100);
+
+    // Without the thread the tips are only recorded
+    walletWitnesses.UpdatedBlockTip(&vIndex[0]);
+    BOOST_CHECK(walletWitnesses.SyncZerocoinWitnesses() == NULL);
+
+    // The thread catches up with the newest tip, however many it skipped
+    walletWitnesses.StartZerocoinWitnessThread();
+    for (const CBlockIndex& index : vIndex)
+        walletWitnesses.UpdatedBlockTip(&index);
+    BOOST_CHECK(walletWitnesses.SyncZerocoinWitnesses() == &vIndex.back());
+
+    walletWitnesses.StopZerocoinWitnessThread();
+    walletWitnesses.UpdatedBlockTip(&vIndex[0]);
+    BOOST_CHECK(walletWitnesses.SyncZerocoinWitnesses() == &vIndex.back());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
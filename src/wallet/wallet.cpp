@@ -1267,9 +1267,14 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            for (CTransaction& tx : block.vtx) {
+            // Pruned blocks hold no unspent outputs, so there is nothing left to find in them
+            std::shared_ptr<const CBlock> pblock;
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                pblock = ReadBlockShared(pindex);
+            if (!pblock)
+                pblock = std::make_shared<const CBlock>();
+            const CBlock& block = *pblock;
+            for (const CTransaction& tx : block.vtx) {
                 if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
                     ret++;
             }
@@ -3940,6 +3945,14 @@ bool CWallet::MintsToInputVector(std::map<CBigNum, CZerocoinMint>& mapMintsSelec
             CMintMeta meta = zNZRTracker->Get(GetSerialHash(mint.GetSerialNumber()));
             CoinWitnessData *coinWitness = zNZRTracker->GetSpendCache(meta.hashStake);
 
+            // The stored witness may already be past an explicitly requested checkpoint
+            if (pindexCheckpoint) {
+                int nHeightStop = pindexCheckpoint->nHeight - 10;
+                nHeightStop -= nHeightStop % 10;
+                if (coinWitness->nHeightAccEnd >= nHeightStop)
+                    coinWitness->SetNull();
+            }
+
             if (!coinWitness->nHeightAccEnd) {
                 *coinWitness = CoinWitnessData(mint);
                 coinWitness->SetHeightMintAdded(mint.GetHeight());
@@ -4770,6 +4783,150 @@ bool CWallet::DatabaseMint(CDeterministicMint& dMint)
     return true;
 }
 
+void CWallet::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    // Accumulating witnesses can take long, so it is left to threadWitnesses, which only needs the newest tip
+    WaitableLock lock(cs_witnessTip);
+    pindexWitnessTip = pindex;
+    condWitnessTip.notify_all();
+}
+
+void CWallet::ThreadZerocoinWitnesses()
+{
+    WaitableLock lock(cs_witnessTip);
+    while (true) {
+        while (pindexWitnessDone == pindexWitnessTip && !fStopWitnesses)
+            condWitnessTip.wait(lock);
+        if (fStopWitnesses)
+            return;
+
+        const CBlockIndex* pindexTip = pindexWitnessTip;
+        lock.unlock();
+        try {
+            UpdateZerocoinWitnesses(pindexTip);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : %s\n", __func__, e.what());
+        }
+        lock.lock();
+        pindexWitnessDone = pindexTip;
+        condWitnessTip.notify_all();
+    }
+}
+
+void CWallet::StartZerocoinWitnessThread()
+{
+    if (!threadWitnesses.joinable())
+        threadWitnesses = std::thread([this] { TraceThread("zwitness", [this] { ThreadZerocoinWitnesses(); }); });
+}
+
+void CWallet::StopZerocoinWitnessThread()
+{
+    if (!threadWitnesses.joinable())
+        return;
+    {
+        WaitableLock lock(cs_witnessTip);
+        fStopWitnesses = true;
+    }
+    condWitnessTip.notify_all();
+    threadWitnesses.join();
+}
+
+const CBlockIndex* CWallet::SyncZerocoinWitnesses()
+{
+    WaitableLock lock(cs_witnessTip);
+    while (threadWitnesses.joinable() && !fStopWitnesses && pindexWitnessDone != pindexWitnessTip)
+        condWitnessTip.wait(lock);
+    return pindexWitnessDone;
+}
+
+/**
+ * Keep the witness of every unspent mint accumulated up to the checkpoint a spend made now
+ * would use, so that MintsToInputVector finds them ready instead of walking the chain.
+ * The witnesses are persisted in the precompute database and resume from it after a restart.
+ */
+void CWallet::UpdateZerocoinWitnesses(const CBlockIndex* pindexTip)
+{
+    if (!zNZRTracker || zNZRTracker->IsEmpty())
+        return;
+
+    // Spends are built on witnesses that are at least two checkpoints deep, see GenerateAccumulatorWitness
+    int nHeightStop = pindexTip->nHeight - pindexTip->nHeight % 10 - 20;
+    if (nHeightStop <= Params().Zerocoin_Block_V2_Start())
+        return;
+
+    // A spend is using the witnesses, catch up on the next block
+    TRY_LOCK(zNZRTracker->cs_spendcache, lockSpendcache);
+    if (!lockSpendcache)
+        return;
+
+    CWalletDB walletdb("precomputes.dat", "cr+");
+    if (hashWitnessStoreTip.IsNull())
+        walletdb.ReadWitnessStoreTip(hashWitnessStoreTip);
+
+    uint256 hashStop;
+    int nHeightFork = std::numeric_limits<int>::max();
+    {
+        LOCK(cs_main);
+        if (nHeightStop > chainActive.Height())
+            return;
+        hashStop = chainActive[nHeightStop - 1]->GetBlockHash();
+        if (hashStop == hashWitnessStoreTip)
+            return;
+
+        // Accumulators are one-way, so witnesses that went through blocks which left the active chain start over
+        if (!hashWitnessStoreTip.IsNull()) {
+            BlockMap::iterator mi = mapBlockIndex.find(hashWitnessStoreTip);
+            const CBlockIndex* pindexFork = mi == mapBlockIndex.end() ? nullptr : chainActive.FindFork(mi->second);
+            if (!pindexFork)
+                nHeightFork = 0;
+            else if (pindexFork != mi->second)
+                nHeightFork = pindexFork->nHeight;
+        }
+    }
+
+    std::vector<std::pair<uint256, CoinWitnessData*> > vStored;
+    for (const CMintMeta& meta : zNZRTracker->GetMints(true)) {
+        if (meta.nHeight >= nHeightStop)
+            continue;
+
+        CoinWitnessData* coinWitness = zNZRTracker->GetSpendCache(meta.hashStake);
+        if (!coinWitness->nHeightAccEnd) {
+            CoinWitnessCacheData data;
+            if (walletdb.ReadPrecompute(meta.hashStake, data) && data.nHeightAccEnd)
+                *coinWitness = CoinWitnessData(data);
+        }
+
+        if (coinWitness->nHeightAccEnd > nHeightFork) {
+            LogPrint("zero", "%s: witness for %s went through a reorganized block, rebuilding\n", __func__, meta.hashStake.GetHex());
+            coinWitness->SetNull();
+            walletdb.ErasePrecompute(meta.hashStake);
+        }
+
+        if (!coinWitness->nHeightAccEnd) {
+            // Deterministic mints can only be regenerated while the wallet is unlocked
+            CZerocoinMint mint;
+            if (IsLocked() || !GetMint(meta.hashSerial, mint))
+                continue;
+            *coinWitness = CoinWitnessData(mint);
+        }
+
+        vStored.emplace_back(meta.hashStake, coinWitness);
+    }
+
+    std::vector<CoinWitnessData*> vWitnesses;
+    for (const auto& it : vStored)
+        vWitnesses.emplace_back(it.second);
+    AccumulateWitnesses(vWitnesses, nHeightStop - 1);
+
+    for (const auto& it : vStored) {
+        if (it.second->nHeightAccEnd)
+            walletdb.WritePrecompute(it.first, CoinWitnessCacheData(it.second));
+    }
+
+    hashWitnessStoreTip = hashStop;
+    walletdb.WriteWitnessStoreTip(hashWitnessStoreTip);
+}
+
 void ThreadPrecomputeSpends()
 {
     boost::this_thread::interruption_point();
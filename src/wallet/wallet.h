@@ -35,6 +35,7 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -197,6 +198,18 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    //! Block the stored zerocoin witnesses were last brought forward to
+    uint256 hashWitnessStoreTip;
+
+    //! Newest tip handed over by UpdatedBlockTip, and the last one threadWitnesses brought the witnesses to
+    CWaitableCriticalSection cs_witnessTip;
+    CConditionVariable condWitnessTip;
+    const CBlockIndex* pindexWitnessTip;
+    const CBlockIndex* pindexWitnessDone;
+    bool fStopWitnesses;
+    std::thread threadWitnesses;
+    void ThreadZerocoinWitnesses();
+
 public:
     bool MintableCoins();
     bool SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInputs, CAmount nTargetAmount, int blockHeight, bool fPrecompute = false);
@@ -296,6 +309,7 @@ public:
 
     ~CWallet()
     {
+        StopZerocoinWitnessThread();
         delete pwalletdbEncryption;
     }
 
@@ -331,6 +345,10 @@ public:
         //Auto Combine Dust
         fCombineDust = false;
         nAutoCombineThreshold = 0;
+
+        pindexWitnessTip = NULL;
+        pindexWitnessDone = NULL;
+        fStopWitnesses = false;
     }
 
     int getZeromintPercentage()
@@ -388,6 +406,12 @@ public:
     const CWalletTx* GetWalletTx(const uint256& hash) const;
 
     void PrecomputeSpends();
+    void UpdateZerocoinWitnesses(const CBlockIndex* pindexTip);
+    //! Start or stop the thread that runs UpdateZerocoinWitnesses for the tips UpdatedBlockTip hands over
+    void StartZerocoinWitnessThread();
+    void StopZerocoinWitnessThread();
+    //! Wait until the witnesses were brought forward to the last tip handed over, and return it
+    const CBlockIndex* SyncZerocoinWitnesses();
 
     //! check whether we are allowed to upgrade (or already support) to the named feature
     bool CanSupportFeature(enum WalletFeature wf)
@@ -475,6 +499,7 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet = false);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void UpdatedBlockTip(const CBlockIndex* pindex);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
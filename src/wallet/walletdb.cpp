@@ -1482,6 +1482,16 @@ bool CWalletDB::ErasePrecompute(const uint256& hash)
     return Erase(std::make_pair(std::string("precompute"), hash));
 }
 
+bool CWalletDB::WriteWitnessStoreTip(const uint256& hashBlock)
+{
+    return Write(std::string("witnessstoretip"), hashBlock);
+}
+
+bool CWalletDB::ReadWitnessStoreTip(uint256& hashBlock)
+{
+    return Read(std::string("witnessstoretip"), hashBlock);
+}
+
 //! map with hashMasterSeed as the key, paired with vector of hashPubcoins and their count
 std::map<uint256, std::vector<std::pair<uint256, uint32_t> > > CWalletDB::MapMintPool()
 {
@@ -196,6 +196,8 @@ public:
     bool WritePrecompute(const uint256& hash, const CoinWitnessCacheData& data);
     bool ReadPrecompute(const uint256& hash, CoinWitnessCacheData& data);
     bool ErasePrecompute(const uint256& hash);
+    bool WriteWitnessStoreTip(const uint256& hashBlock);
+    bool ReadWitnessStoreTip(uint256& hashBlock);
 
 private:
     CWalletDB(const CWalletDB&);
@@ -6,10 +6,34 @@
 
 #include "accumulatormap.h"
 #include "accumulators.h"
+#include "checkqueue.h"
 #include "main.h"
 #include "txdb.h"
 #include "libzerocoin/Denominations.h"
 
+static CSharedCheckQueue<CAccumulateCheck> accumulatorcheckqueue;
+
+void ThreadAccumulatorCheck()
+{
+    RenameThread("nodezero-accch");
+    accumulatorcheckqueue.Thread();
+}
+
+bool CAccumulateCheck::operator()()
+{
+    try {
+        for (const libzerocoin::PublicCoin& pubCoin : vPubcoins) {
+            if (fSkipValidation)
+                pAccumulator->increment(pubCoin.getValue());
+            else
+                pAccumulator->accumulate(pubCoin);
+        }
+    } catch (const std::exception& e) {
+        return error("CAccumulateCheck(): %s", e.what());
+    }
+    return true;
+}
+
 
 //Construct accumulators for all denominations
 AccumulatorMap::AccumulatorMap(libzerocoin::ZerocoinParams* params)
@@ -73,6 +97,35 @@ bool AccumulatorMap::Accumulate(const libzerocoin::PublicCoin& pubCoin, bool fSk
     return true;
 }
 
+//Add zerocoins to the accumulators of their denominations, one denomination per check thread.
+bool AccumulatorMap::Accumulate(const std::list<libzerocoin::PublicCoin>& listPubcoins, bool fSkipValidation)
+{
+    std::map<libzerocoin::CoinDenomination, std::vector<libzerocoin::PublicCoin> > mapPubcoins;
+    for (const libzerocoin::PublicCoin& pubCoin : listPubcoins) {
+        libzerocoin::CoinDenomination denom = pubCoin.getDenomination();
+        if (denom == libzerocoin::CoinDenomination::ZQ_ERROR)
+            return false;
+        mapPubcoins[denom].emplace_back(pubCoin);
+    }
+
+    std::vector<CAccumulateCheck> vChecks;
+    for (const auto& denomPubcoins : mapPubcoins)
+        vChecks.emplace_back(mapAccumulators.at(denomPubcoins.first).get(), denomPubcoins.second, fSkipValidation);
+
+    // Each check accumulates a whole denomination
+    CCheckQueueTryControl<CAccumulateCheck> control(accumulatorcheckqueue, nScriptCheckThreads && vChecks.size() > 1);
+    if (!control.IsQueued()) {
+        for (CAccumulateCheck& check : vChecks) {
+            if (!check())
+                return false;
+        }
+        return true;
+    }
+
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 libzerocoin::Accumulator AccumulatorMap::GetAccumulator(libzerocoin::CoinDenomination denom)
 {
     return libzerocoin::Accumulator(params, denom, GetValue(denom));
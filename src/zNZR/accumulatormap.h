@@ -11,6 +11,38 @@
 #include "libzerocoin/Coin.h"
 #include "accumulatorcheckpoints.h"
 
+#include <list>
+#include <vector>
+
+/**
+ * Closure adding the pubcoins of one denomination to its accumulator. The denominations are
+ * independent of each other, so AccumulatorMap spreads them over the accumulator check queue.
+ */
+class CAccumulateCheck
+{
+private:
+    libzerocoin::Accumulator* pAccumulator;
+    std::vector<libzerocoin::PublicCoin> vPubcoins;
+    bool fSkipValidation;
+
+public:
+    CAccumulateCheck() : pAccumulator(NULL), fSkipValidation(false) {}
+    CAccumulateCheck(libzerocoin::Accumulator* pAccumulatorIn, const std::vector<libzerocoin::PublicCoin>& vPubcoinsIn, bool fSkipValidationIn) :
+        pAccumulator(pAccumulatorIn), vPubcoins(vPubcoinsIn), fSkipValidation(fSkipValidationIn) {}
+
+    bool operator()();
+
+    void swap(CAccumulateCheck& check)
+    {
+        std::swap(pAccumulator, check.pAccumulator);
+        vPubcoins.swap(check.vPubcoins);
+        std::swap(fSkipValidation, check.fSkipValidation);
+    }
+};
+
+/** Run an instance of the accumulator checking thread */
+void ThreadAccumulatorCheck();
+
 //A map with an accumulator for each denomination
 class AccumulatorMap
 {
@@ -22,6 +54,7 @@ public:
     bool Load(uint256 nCheckpoint);
     void Load(const AccumulatorCheckpoints::Checkpoint& checkpoint);
     bool Accumulate(const libzerocoin::PublicCoin& pubCoin, bool fSkipValidation = false);
+    bool Accumulate(const std::list<libzerocoin::PublicCoin>& listPubcoins, bool fSkipValidation = false);
     libzerocoin::Accumulator GetAccumulator(libzerocoin::CoinDenomination denom);
     CBigNum GetValue(libzerocoin::CoinDenomination denom);
     uint256 GetCheckpoint();
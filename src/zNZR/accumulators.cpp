@@ -266,7 +266,7 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
     bool fFilterInvalid = nHeight >= Params().Zerocoin_Block_RecalculateAccumulators();
 
     //Accumulate all coins over the last ten blocks that havent been accumulated (height - 20 through height - 11)
-    int nTotalMintsFound = 0;
+    std::list<libzerocoin::PublicCoin> listPubcoinsRange;
      if (nHeightCheckpoint < 20)
           nHeightCheckpoint = 20;
     CBlockIndex *pindex = chainActive[nHeightCheckpoint - 20];
@@ -283,27 +283,34 @@ bool CalculateAccumulatorCheckpoint(int nHeight, uint256& nCheckpoint, Accumulat
         }
 
         //grab mints from this block
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex))
-            return error("%s: failed to read block from disk", __func__);
-
         std::list<libzerocoin::PublicCoin> listPubcoins;
-        if (!BlockToPubcoinList(block, listPubcoins, fFilterInvalid))
-            return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
-
-        nTotalMintsFound += listPubcoins.size();
-        LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
+        if (fFilterInvalid) {
+            //only the denominations minted in this block have pubcoins in the index
+            std::set<libzerocoin::CoinDenomination> setDenoms(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end());
+            for (const libzerocoin::CoinDenomination denom : setDenoms) {
+                if (!BlockIndexToPubcoinList(pindex, denom, listPubcoins))
+                    return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
+            }
+        } else {
+            std::shared_ptr<const CBlock> pblock = ReadBlockShared(pindex);
+            if (!pblock)
+                return error("%s: failed to read block from disk", __func__);
 
-        //add the pubcoins to accumulator
-        for (const libzerocoin::PublicCoin& pubcoin : listPubcoins) {
-            if(!mapAccumulators.Accumulate(pubcoin, true))
-                return error("%s: failed to add pubcoin to accumulator at height %d", __func__, pindex->nHeight);
+            if (!BlockToPubcoinList(*pblock, listPubcoins, fFilterInvalid))
+                return error("%s: failed to get zerocoin mintlist from block %d", __func__, pindex->nHeight);
         }
+
+        LogPrint("zero", "%s found %d mints\n", __func__, listPubcoins.size());
+        listPubcoinsRange.splice(listPubcoinsRange.end(), listPubcoins);
         pindex = chainActive.Next(pindex);
     }
 
+    //add the pubcoins to the accumulators, the denominations are accumulated in parallel
+    if (!mapAccumulators.Accumulate(listPubcoinsRange, true))
+        return error("%s: failed to add pubcoins to accumulators at height %d", __func__, nHeight);
+
     // if there were no new mints found, the accumulator checkpoint will be the same as the last checkpoint
-    if (nTotalMintsFound == 0)
+    if (listPubcoinsRange.empty())
         nCheckpoint = chainActive[nHeight - 1]->nAccumulatorCheckpoint;
     else
         nCheckpoint = mapAccumulators.GetCheckpoint();
@@ -364,11 +371,18 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
 
 std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex){
     //grab mints from this block
-    CBlock block;
-    if(!ReadBlockFromDisk(block, pindex))
+    std::shared_ptr<const CBlock> pblock = ReadBlockShared(pindex);
+    if(!pblock)
         throw GetPubcoinException("GetPubcoinFromBlock: failed to read block from disk while adding pubcoins to witness");
     std::list<libzerocoin::PublicCoin> listPubcoins;
-    if(!BlockToPubcoinList(block, listPubcoins, true))
+    if(!BlockToPubcoinList(*pblock, listPubcoins, true))
+        throw GetPubcoinException("GetPubcoinFromBlock: failed to get zerocoin mintlist from block "+std::to_string(pindex->nHeight)+"\n");
+    return listPubcoins;
+}
+
+std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex, const libzerocoin::CoinDenomination denom){
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    if(!BlockIndexToPubcoinList(pindex, denom, listPubcoins))
         throw GetPubcoinException("GetPubcoinFromBlock: failed to get zerocoin mintlist from block "+std::to_string(pindex->nHeight)+"\n");
     return listPubcoins;
 }
@@ -382,11 +396,7 @@ int AddBlockMintsToAccumulator(const libzerocoin::CoinDenomination den, const CB
     int nMintsAdded = 0;
     if (pindex->MintedDenomination(den)) {
         //add the mints to the witness
-        for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex)) {
-            if (pubcoin.getDenomination() != den) {
-                continue;
-            }
-
+        for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex, den)) {
             if (isWitness && filter.contains(pubcoin.getValue().getvch())) {
                 notAddedCoins.emplace_back(pubcoin.getValue());
                 continue;
@@ -407,10 +417,7 @@ int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nH
     int nMintsAdded = 0;
     if (pindex->MintedDenomination(coin.getDenomination())) {
         //add the mints to the witness
-        for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex)) {
-            if (pubcoin.getDenomination() != coin.getDenomination())
-                continue;
-
+        for (const libzerocoin::PublicCoin& pubcoin : GetPubcoinFromBlock(pindex, coin.getDenomination())) {
             if (isWitness && pindex->nHeight == nHeightMintAdded && pubcoin.getValue() == coin.getValue())
                 continue;
 
@@ -531,6 +538,95 @@ void AccumulateRange(CoinWitnessData* coinWitness, int nHeightEnd)
 }
 
 
+void AccumulateWitnesses(const std::vector<CoinWitnessData*>& vWitnesses, int nHeightEnd)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    const int nHeightDoubleCounted = Params().Zerocoin_Block_Double_Accumulated() + 10;
+
+    std::vector<CoinWitnessData*> vPending;
+    int nHeightStart = nHeightEnd + 1;
+    for (CoinWitnessData* coinWitness : vWitnesses) {
+        try {
+            // Start from the checkpoint preceding the mint, as GenerateAccumulatorWitness does
+            if (!coinWitness->nHeightAccEnd) {
+                coinWitness->pAccumulator = std::unique_ptr<libzerocoin::Accumulator>(new libzerocoin::Accumulator(Params().Zerocoin_Params(false), coinWitness->denom));
+                coinWitness->pWitness = std::unique_ptr<libzerocoin::AccumulatorWitness>(new libzerocoin::AccumulatorWitness(Params().Zerocoin_Params(false), *coinWitness->pAccumulator, *coinWitness->coin));
+                coinWitness->SetHeightMintAdded(SearchMintHeightOf(coinWitness->coin->getValue()));
+
+                CBigNum bnAccValue = 0;
+                if (GetAccumulatorValue(coinWitness->nHeightCheckpoint, coinWitness->denom, bnAccValue)) {
+                    libzerocoin::Accumulator witnessAccumulator(Params().Zerocoin_Params(false), coinWitness->denom, bnAccValue);
+                    coinWitness->pAccumulator->setValue(witnessAccumulator.getValue());
+                }
+            }
+
+            int nHeightFrom = std::max(coinWitness->nHeightAccStart, coinWitness->nHeightAccEnd + 1);
+            if (nHeightFrom > nHeightEnd)
+                continue;
+
+            // The range that was accumulated twice is left to AccumulateRange
+            if (nHeightFrom <= nHeightDoubleCounted && nHeightEnd >= nHeightDoubleCounted) {
+                AccumulateRange(coinWitness, nHeightEnd);
+                continue;
+            }
+
+            nHeightStart = std::min(nHeightStart, nHeightFrom);
+            vPending.emplace_back(coinWitness);
+        } catch (searchMintHeightException e) {
+            error("%s: searchMintHeightException: %s", __func__, e.message);
+            coinWitness->SetNull();
+        } catch (ChecksumInDbNotFoundException e) {
+            error("%s: ChecksumInDbNotFoundException: %s", __func__, e.message);
+            coinWitness->SetNull();
+        } catch (GetPubcoinException e) {
+            error("%s: GetPubcoinException: %s", __func__, e.message);
+        }
+    }
+
+    if (vPending.empty())
+        return;
+
+    // Block index entries are never freed, so the disk reads below can run without cs_main
+    std::vector<const CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        for (int nHeight = nHeightStart; nHeight <= nHeightEnd && nHeight <= chainActive.Height(); nHeight++)
+            vBlocks.emplace_back(chainActive[nHeight]);
+    }
+
+    LogPrint("zero", "%s: witnesses=%d start=%d end=%d\n", __func__, vPending.size(), nHeightStart, nHeightEnd);
+    try {
+        for (const CBlockIndex* pindex : vBlocks) {
+            // The pubcoins of each denomination are looked up at most once for all of the witnesses
+            std::map<libzerocoin::CoinDenomination, std::list<libzerocoin::PublicCoin> > mapPubcoins;
+            for (CoinWitnessData* coinWitness : vPending) {
+                if (pindex->nHeight <= coinWitness->nHeightAccEnd || pindex->nHeight < coinWitness->nHeightAccStart)
+                    continue;
+
+                if (pindex->MintedDenomination(coinWitness->denom)) {
+                    if (!mapPubcoins.count(coinWitness->denom))
+                        mapPubcoins[coinWitness->denom] = GetPubcoinFromBlock(pindex, coinWitness->denom);
+
+                    for (const libzerocoin::PublicCoin& pubcoin : mapPubcoins.at(coinWitness->denom)) {
+                        if (pindex->nHeight == coinWitness->nHeightMintAdded && pubcoin.getValue() == coinWitness->coin->getValue())
+                            continue;
+
+                        coinWitness->pAccumulator->increment(pubcoin.getValue());
+                        ++coinWitness->nMintsAdded;
+                    }
+                }
+                coinWitness->nHeightAccEnd = pindex->nHeight;
+            }
+        }
+    } catch (GetPubcoinException e) {
+        // Every witness stays consistent with the last block it went through and resumes from there
+        error("%s: GetPubcoinException: %s", __func__, e.message);
+    }
+
+    int64_t nTimeEnd = GetTimeMicros();
+    LogPrint("bench", "        - Witnesses accumulated in %.2fms\n", 0.001 * (nTimeEnd - nTimeStart));
+}
+
 bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint)
 {
     try {
@@ -50,7 +50,16 @@ bool GenerateAccumulatorWitness(
 
 
 bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint);
+
+/**
+ * Bring stored witnesses forward so they have accumulated every block up to nHeightEnd.
+ * The pubcoins of each block are looked up once for all of the witnesses, and witnesses that were
+ * never accumulated start from the checkpoint preceding their mint.
+ * Witnesses that cannot be started are reset so the caller rebuilds them.
+ */
+void AccumulateWitnesses(const std::vector<CoinWitnessData*>& vWitnesses, int nHeightEnd);
 std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex);
+std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex, const libzerocoin::CoinDenomination denom);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValue(int& nHeight, const libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
 bool GetAccumulatorValueFromChecksum(uint32_t nChecksum, bool fMemoryOnly, CBigNum& bnAccValue);
@@ -10,6 +10,9 @@
 #include "main.h"
 #include "txdb.h"
 #include "guiinterface.h"
+#include "init.h"
+
+#include <boost/thread.hpp>
 
 // 6 comes from OPCODE (1) + vch.size() (1) + BIGNUM size (4)
 #define SCRIPT_OFFSET 6
@@ -82,6 +85,52 @@ bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>&
     return true;
 }
 
+//! The valid mints of a block by denomination, with an entry for every denomination
+bool BlockToPubcoinIndex(const CBlock& block, std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> >& mapPubcoins)
+{
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    if (!BlockToPubcoinList(block, listPubcoins, true))
+        return false;
+
+    // Every denomination gets a record, so a denomination without valid mints is not mistaken for a missing entry
+    for (const libzerocoin::CoinDenomination denom : libzerocoin::zerocoinDenomList)
+        mapPubcoins[denom];
+    for (const libzerocoin::PublicCoin& pubcoin : listPubcoins)
+        mapPubcoins[pubcoin.getDenomination()].emplace_back(pubcoin.getValue());
+
+    return true;
+}
+
+bool IndexBlockPubcoins(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> > mapPubcoins;
+    if (!BlockToPubcoinIndex(block, mapPubcoins))
+        return false;
+
+    return zerocoinDB->WriteBlockMints(pindex->GetBlockHash(), mapPubcoins);
+}
+
+//! Same as BlockToPubcoinList with invalid outpoints filtered, for one denomination, without reading the block when it is indexed
+bool BlockIndexToPubcoinList(const CBlockIndex* pindex, const libzerocoin::CoinDenomination denom, std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    std::vector<CBigNum> vValues;
+    if (!zerocoinDB->ReadBlockMints(pindex->GetBlockHash(), denom, vValues)) {
+        // Blocks connected before the index existed are indexed on first use
+        std::shared_ptr<const CBlock> pblock = ReadBlockShared(pindex);
+        if (!pblock)
+            return error("%s: failed to read block %d from disk", __func__, pindex->nHeight);
+        if (!IndexBlockPubcoins(*pblock, pindex))
+            return error("%s: failed to index pubcoins of block %d", __func__, pindex->nHeight);
+        if (!zerocoinDB->ReadBlockMints(pindex->GetBlockHash(), denom, vValues))
+            return error("%s: failed to read pubcoins of block %d", __func__, pindex->nHeight);
+    }
+
+    for (const CBigNum& bnValue : vValues)
+        listPubcoins.emplace_back(libzerocoin::PublicCoin(Params().Zerocoin_Params(false), bnValue, denom));
+
+    return true;
+}
+
 //return a list of zerocoin mints contained in a specific block
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid)
 {
@@ -256,89 +305,190 @@ bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& tx
     return IsTransactionInChain(txidSpend, nHeightTx, tx);
 }
 
+namespace {
+
+//! Blocks handed out ahead of the writer, bounds the memory held by the pipeline
+static const int REINDEX_ZEROCOIN_WINDOW = 2000;
+//! Blocks committed per database batch, together with the progress height
+static const int REINDEX_ZEROCOIN_BATCH = 1000;
+
+void ReindexZerocoinBlock(const CBlockIndex* pindex, CZerocoinReindexEntry& entry)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex)) {
+        entry.strError = _("Reindexing zerocoin failed");
+        return;
+    }
+    entry.hashBlock = pindex->GetBlockHash();
+
+    bool fHasMints = false;
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.IsCoinBase() || !tx.ContainsZerocoins())
+            continue;
+
+        uint256 txid = tx.GetHash();
+        //Record Serials
+        if (tx.HasZerocoinSpendInputs()) {
+            for (auto& in : tx.vin) {
+                bool isPublicSpend = in.IsZerocoinPublicSpend();
+                if (!in.IsZerocoinSpend() && !isPublicSpend)
+                    continue;
+                if (isPublicSpend) {
+                    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+                    PublicCoinSpend publicSpend(params);
+                    CValidationState state;
+                    if (!ZNZRModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)){
+                        entry.strError = _("Failed to parse public spend");
+                        return;
+                    }
+                    entry.vSpendInfo.push_back(std::make_pair(publicSpend, txid));
+                } else {
+                    libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in, pindex->nHeight);
+                    entry.vSpendInfo.push_back(std::make_pair(spend, txid));
+                }
+            }
+        }
+
+        //Record mints
+        if (tx.HasZerocoinMintOutputs()) {
+            for (auto& out : tx.vout) {
+                if (!out.IsZerocoinMint())
+                    continue;
+
+                CValidationState state;
+                libzerocoin::PublicCoin coin(Params().Zerocoin_Params(pindex->nHeight < Params().Zerocoin_Block_V2_Start()));
+                TxOutToPublicCoin(out, coin, state);
+                entry.vMintInfo.push_back(std::make_pair(coin, txid));
+                fHasMints = true;
+            }
+        }
+    }
+
+    if (fHasMints && !BlockToPubcoinIndex(block, entry.mapPubcoins))
+        entry.strError = _("Reindexing zerocoin failed");
+}
+
+}
+
+void ThreadReindexZerocoin(CZerocoinReindexQueue* queue, ReindexZerocoinBlockFn fn)
+{
+    RenameThread("nodezero-zreindex");
+    while (true) {
+        size_t nBlock;
+        {
+            boost::unique_lock<boost::mutex> lock(queue->mutex);
+            while (!queue->fStop && queue->nNext < queue->vBlocks.size() && queue->nNext >= queue->nWritten + REINDEX_ZEROCOIN_WINDOW)
+                queue->condWork.wait(lock);
+            if (queue->fStop || queue->nNext >= queue->vBlocks.size())
+                return;
+            nBlock = queue->nNext++;
+        }
+
+        CZerocoinReindexEntry entry;
+        try {
+            fn(queue->vBlocks[nBlock], entry);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : block %u: %s\n", __func__, nBlock, e.what());
+            entry.strError = _("Reindexing zerocoin failed");
+        } catch (...) {
+            LogPrintf("%s : block %u: unknown exception\n", __func__, nBlock);
+            entry.strError = _("Reindexing zerocoin failed");
+        }
+
+        boost::unique_lock<boost::mutex> lock(queue->mutex);
+        queue->mapDone[nBlock] = std::move(entry);
+        queue->condDone.notify_all();
+    }
+}
+
+CZerocoinReindexEntry TakeReindexEntry(CZerocoinReindexQueue& queue, size_t nBlock)
+{
+    boost::unique_lock<boost::mutex> lock(queue.mutex);
+    while (!queue.mapDone.count(nBlock))
+        queue.condDone.wait(lock);
+    CZerocoinReindexEntry entry = std::move(queue.mapDone.at(nBlock));
+    queue.mapDone.erase(nBlock);
+    queue.nWritten = nBlock + 1;
+    queue.condWork.notify_all();
+    return entry;
+}
+
 std::string ReindexZerocoinDB()
 {
-    if (!zerocoinDB->WipeCoins("spends") || !zerocoinDB->WipeCoins("mints")) {
-        return _("Failed to wipe zerocoinDB");
+    // An interrupted reindex continues after the last committed batch
+    int nHeightStart = Params().Zerocoin_StartHeight();
+    int nHeightProgress;
+    if (zerocoinDB->ReadReindexProgress(nHeightProgress)) {
+        nHeightStart = nHeightProgress + 1;
+        LogPrintf("Resuming zerocoin reindex at block %d\n", nHeightStart);
+    } else {
+        if (!zerocoinDB->WipeCoins("spends") || !zerocoinDB->WipeCoins("mints") || !zerocoinDB->WriteReindexProgress(nHeightStart - 1))
+            return _("Failed to wipe zerocoinDB");
     }
 
     uiInterface.ShowProgress(_("Reindexing zerocoin database..."), 0);
 
-    CBlockIndex* pindex = chainActive[Params().Zerocoin_StartHeight()];
-    std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
-    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
-    while (pindex) {
-        uiInterface.ShowProgress(_("Reindexing zerocoin database..."), std::max(1, std::min(99, (int)((double)(pindex->nHeight - Params().Zerocoin_StartHeight()) / (double)(chainActive.Height() - Params().Zerocoin_StartHeight()) * 100))));
+    // Blocks are read and parsed by the workers, and written in order by this thread
+    CZerocoinReindexQueue queue;
+    for (CBlockIndex* pindex = chainActive[nHeightStart]; pindex; pindex = chainActive.Next(pindex))
+        queue.vBlocks.emplace_back(pindex);
 
-        if (pindex->nHeight % 1000 == 0)
-            LogPrintf("Reindexing zerocoin : block %d...\n", pindex->nHeight);
+    boost::thread_group threadGroup;
+    int nThreads = std::max(nScriptCheckThreads, 2);
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&ThreadReindexZerocoin, &queue, &ReindexZerocoinBlock));
 
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            return _("Reindexing zerocoin failed");
+    std::string strError;
+    std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
+    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
+    std::vector<std::pair<uint256, std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> > > > vBlockMints;
+    for (size_t nBlock = 0; nBlock < queue.vBlocks.size(); nBlock++) {
+        const CBlockIndex* pindex = queue.vBlocks[nBlock];
+        if (ShutdownRequested()) {
+            LogPrintf("Reindexing zerocoin interrupted at block %d, it continues on the next start\n", pindex->nHeight);
+            break;
         }
 
-        for (const CTransaction& tx : block.vtx) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                if (tx.IsCoinBase())
-                    break;
+        CZerocoinReindexEntry entry = TakeReindexEntry(queue, nBlock);
+        if (!entry.strError.empty()) {
+            LogPrintf("Reindexing zerocoin aborted at block %d\n", pindex->nHeight);
+            strError = entry.strError;
+            break;
+        }
 
-                if (tx.ContainsZerocoins()) {
-                    uint256 txid = tx.GetHash();
-                    //Record Serials
-                    if (tx.HasZerocoinSpendInputs()) {
-                        for (auto& in : tx.vin) {
-                            bool isPublicSpend = in.IsZerocoinPublicSpend();
-                            if (!in.IsZerocoinSpend() && !isPublicSpend)
-                                continue;
-                            if (isPublicSpend) {
-                                libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
-                                PublicCoinSpend publicSpend(params);
-                                CValidationState state;
-                                if (!ZNZRModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)){
-                                    return _("Failed to parse public spend");
-                                }
-                                vSpendInfo.push_back(std::make_pair(publicSpend, txid));
-                            } else {
-                                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
-                                vSpendInfo.push_back(std::make_pair(spend, txid));
-                            }
-                        }
-                    }
+        vSpendInfo.insert(vSpendInfo.end(), entry.vSpendInfo.begin(), entry.vSpendInfo.end());
+        vMintInfo.insert(vMintInfo.end(), entry.vMintInfo.begin(), entry.vMintInfo.end());
+        if (!entry.mapPubcoins.empty())
+            vBlockMints.emplace_back(entry.hashBlock, std::move(entry.mapPubcoins));
 
-                    //Record mints
-                    if (tx.HasZerocoinMintOutputs()) {
-                        for (auto& out : tx.vout) {
-                            if (!out.IsZerocoinMint())
-                                continue;
-
-                            CValidationState state;
-                            libzerocoin::PublicCoin coin(Params().Zerocoin_Params(pindex->nHeight < Params().Zerocoin_Block_V2_Start()));
-                            TxOutToPublicCoin(out, coin, state);
-                            vMintInfo.push_back(std::make_pair(coin, txid));
-                        }
-                    }
-                }
+        // Commit the entries together with the height they reach, so an interruption resumes from here
+        if (pindex->nHeight % REINDEX_ZEROCOIN_BATCH == 0 || nBlock + 1 == queue.vBlocks.size()) {
+            if (!zerocoinDB->WriteReindexBatch(vSpendInfo, vMintInfo, vBlockMints, pindex->nHeight)) {
+                strError = _("Error writing zerocoinDB to disk");
+                break;
             }
-        }
-
-        // Flush the zerocoinDB to disk every 100 blocks
-        if (pindex->nHeight % 100 == 0) {
-            if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
-                return _("Error writing zerocoinDB to disk");
             vSpendInfo.clear();
             vMintInfo.clear();
+            vBlockMints.clear();
+
+            LogPrintf("Reindexing zerocoin : block %d...\n", pindex->nHeight);
+            uiInterface.ShowProgress(_("Reindexing zerocoin database..."), std::max(1, std::min(99, (int)((double)(nBlock + 1) / (double)queue.vBlocks.size() * 100))));
         }
+    }
 
-        pindex = chainActive.Next(pindex);
+    {
+        boost::unique_lock<boost::mutex> lock(queue.mutex);
+        queue.fStop = true;
+        queue.condWork.notify_all();
     }
+    threadGroup.join_all();
     uiInterface.ShowProgress("", 100);
 
-    // Final flush to disk in case any remaining information exists
-    if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
-        return _("Error writing zerocoinDB to disk");
+    if (!strError.empty() || ShutdownRequested())
+        return strError;
 
-    uiInterface.ShowProgress("", 100);
+    if (!zerocoinDB->EraseReindexProgress())
+        return _("Error writing zerocoinDB to disk");
 
     return "";
 }
@@ -349,13 +499,18 @@ bool RemoveSerialFromDB(const CBigNum& bnSerial)
 }
 
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin)
+{
+    return TxInToZerocoinSpend(txin, chainActive.Height());
+}
+
+libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin, int nHeight)
 {
     // extract the CoinSpend from the txin
     std::vector<char, zero_after_free_allocator<char> > dataTxIn;
     dataTxIn.insert(dataTxIn.end(), txin.scriptSig.begin() + BIGNUM_SIZE, txin.scriptSig.end());
     CDataStream serializedCoinSpend(dataTxIn, SER_NETWORK, PROTOCOL_VERSION);
 
-    libzerocoin::ZerocoinParams* paramsAccumulator = Params().Zerocoin_Params(chainActive.Height() < Params().Zerocoin_Block_V2_Start());
+    libzerocoin::ZerocoinParams* paramsAccumulator = Params().Zerocoin_Params(nHeight < Params().Zerocoin_Block_V2_Start());
     libzerocoin::CoinSpend spend(Params().Zerocoin_Params(true), paramsAccumulator, serializedCoinSpend);
 
     return spend;
@@ -10,10 +10,18 @@
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/Denominations.h"
 #include "libzerocoin/CoinSpend.h"
+#include "uint256.h"
+
+#include <functional>
 #include <list>
+#include <map>
 #include <string>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CBlock;
+class CBlockIndex;
 class CBigNum;
 struct CMintMeta;
 class CTransaction;
@@ -21,13 +29,14 @@ class CTxIn;
 class CTxOut;
 class CValidationState;
 class CZerocoinMint;
-class uint256;
 
 bool BlockToMintValueVector(const CBlock& block, const libzerocoin::CoinDenomination denom, std::vector<CBigNum>& vValues);
 bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid);
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid);
+bool BlockIndexToPubcoinList(const CBlockIndex* pindex, const libzerocoin::CoinDenomination denom, std::list<libzerocoin::PublicCoin>& listPubcoins);
 void FindMints(std::vector<CMintMeta> vMintsToFind, std::vector<CMintMeta>& vMintsToUpdate, std::vector<CMintMeta>& vMissingMints);
 int GetZerocoinStartHeight();
+bool IndexBlockPubcoins(const CBlock& block, const CBlockIndex* pindex);
 bool GetZerocoinMint(const CBigNum& bnPubcoin, uint256& txHash);
 bool IsPubcoinInBlockchain(const uint256& hashPubcoin, uint256& txid);
 bool IsSerialKnown(const CBigNum& bnSerial);
@@ -37,8 +46,39 @@ bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& tx
 bool RemoveSerialFromDB(const CBigNum& bnSerial);
 std::string ReindexZerocoinDB();
 libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin);
+libzerocoin::CoinSpend TxInToZerocoinSpend(const CTxIn& txin, int nHeight);
 bool TxOutToPublicCoin(const CTxOut& txout, libzerocoin::PublicCoin& pubCoin, CValidationState& state);
 std::list<libzerocoin::CoinDenomination> ZerocoinSpendListFromBlock(const CBlock& block, bool fFilterInvalid);
 
+//! Zerocoin entries of one block, extracted by the reindex workers
+struct CZerocoinReindexEntry
+{
+    std::string strError;
+    uint256 hashBlock;
+    std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
+    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
+    std::map<libzerocoin::CoinDenomination, std::vector<CBigNum> > mapPubcoins;
+};
+
+//! Work shared by the reindex workers and the writer
+struct CZerocoinReindexQueue
+{
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    std::vector<const CBlockIndex*> vBlocks;
+    size_t nNext = 0;
+    size_t nWritten = 0;
+    bool fStop = false;
+    std::map<size_t, CZerocoinReindexEntry> mapDone;
+};
+
+typedef std::function<void(const CBlockIndex*, CZerocoinReindexEntry&)> ReindexZerocoinBlockFn;
+
+/** Worker of the zerocoin reindex: extracts the queued blocks with fn. A block that fails
+ *  or throws still gets an entry, carrying the error, so the writer never waits forever. */
+void ThreadReindexZerocoin(CZerocoinReindexQueue* queue, ReindexZerocoinBlockFn fn);
+/** Wait for the entry of block nBlock and hand it to the writer, in queue order. */
+CZerocoinReindexEntry TakeReindexEntry(CZerocoinReindexQueue& queue, size_t nBlock);
 
 #endif //NZR_ZNZRCHAIN_H